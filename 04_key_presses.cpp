@@ -4,9 +4,14 @@
 #include <SDL.h>
 #endif
 
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
+
+#include "surface_registry.h"
 
 // --------------------
 // -------------------- Prototypes --------------------
@@ -20,6 +25,15 @@ bool loadMedia();
 void close();
 // Loads individual image.
 SDL_Surface* loadSurface(std::string path);
+// Returns a key press image, reloading it if it was evicted.
+SDL_Surface* keyPressSurface(int which);
+// Timer callback pushing one synthetic arrow key press; returns the delay
+// until the next one, or 0 once all are pushed.
+Uint32 injectKeyPress(Uint32 interval, void *param);
+// Records the latency of key presses shown by the frame just presented.
+void recordPresent(Uint64 presentCounter);
+// Prints the latency histogram.
+void reportLatency();
 
 // --------------------
 // -------------------- Globals --------------------
@@ -45,14 +59,61 @@ SDL_Window *gWindow = NULL;
 SDL_Surface *gScreenSurface = NULL;
 // The image we will load and show on the screen.
 SDL_Surface *gKeyPressSurfaces[KEY_PRESS_SURFACE_TOTAL];
+// Files the key press images are loaded from.
+const char *KEY_PRESS_PATHS[KEY_PRESS_SURFACE_TOTAL] = {
+  "04_key_presses/press.bmp",
+  "04_key_presses/up.bmp",
+  "04_key_presses/down.bmp",
+  "04_key_presses/left.bmp",
+  "04_key_presses/right.bmp",
+};
 // Current displayed image.
 SDL_Surface *gCurrentSurface = NULL;
 
+// Width of a latency histogram bucket in milliseconds.
+const int LATENCY_BUCKET_MS = 1;
+// Number of histogram buckets; the last one collects everything slower.
+const int LATENCY_BUCKETS = 50;
+// Key presses measured in synthetic mode unless given on the command line.
+const int DEFAULT_SYNTHETIC_PRESSES = 500;
+
+// Measure input-to-photon latency.
+bool gMeasureLatency = false;
+// Inject key presses with SDL_PushEvent instead of waiting for a user.
+bool gSyntheticInput = false;
+// Synthetic presses to measure, and how many have been pushed so far. The
+// count is only touched by the timer thread.
+int gSyntheticPresses = 0;
+int gPressesInjected = 0;
+// Timer pushing the synthetic presses, and the window they are sent to.
+SDL_TimerID gInjectionTimer = 0;
+Uint32 gInjectionWindowID = 0;
+// Timestamps of key presses handled since the last present.
+std::vector<Uint32> gPendingPresses;
+// Measured latencies in milliseconds.
+std::vector<double> gLatencies;
+// Reference points mapping the performance counter onto SDL_GetTicks(),
+// which is the clock of event timestamps.
+Uint32 gTicksOrigin = 0;
+Uint64 gCounterOrigin = 0;
+
 // --------------------
 // -------------------- Main --------------------
 // --------------------
 
 int main(int argc, char **argv) {
+  // Track surface memory against SURFACE_BUDGET_MB.
+  initSurfaceRegistry();
+
+  // --latency measures key presses from the user; --latency-synthetic [N]
+  // injects N presses, which also works under SDL_VIDEODRIVER=dummy.
+  if (argc > 1) {
+    std::string mode = argv[1];
+    gMeasureLatency = mode == "--latency" || mode == "--latency-synthetic";
+    gSyntheticInput = mode == "--latency-synthetic";
+    gSyntheticPresses = argc > 2 ? atoi(argv[2]) : DEFAULT_SYNTHETIC_PRESSES;
+  }
+
   // Start up SDL and create window.
   if (!init()) {
     std::cout << "Failed to initialize!\n";
@@ -67,10 +128,32 @@ int main(int argc, char **argv) {
       // Event handler.
       SDL_Event e;
       // Set default current surface.
-      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT];
+      gCurrentSurface = keyPressSurface(KEY_PRESS_SURFACE_DEFAULT);
       
+      // Map the performance counter onto event time.
+      gTicksOrigin = SDL_GetTicks();
+      gCounterOrigin = SDL_GetPerformanceCounter();
+
+      // Push synthetic presses from SDL's timer thread so that they arrive
+      // at any point of the frame, not just before the event loop.
+      if (gSyntheticInput) {
+	gInjectionWindowID = SDL_GetWindowID(gWindow);
+	gInjectionTimer = SDL_AddTimer(1, injectKeyPress, NULL);
+	if (gInjectionTimer == 0) {
+	  std::cout << "Unable to start key press timer! SDL_Error: " << SDL_GetError() << "\n";
+	  quit = true;
+	}
+      }
+
       // While application is running.
       while (!quit) {
+	// Stop once every injected press has been presented.
+	if (gSyntheticInput && (int)gLatencies.size() >= gSyntheticPresses) {
+	  quit = true;
+	}
+	// Dump surface memory on SIGUSR1.
+	pollSurfaceRegistrySignal();
+
 	// Handle events on queue.
 	while (SDL_PollEvent(&e) != 0) {
 	  // User requests quit.
@@ -78,33 +161,58 @@ int main(int argc, char **argv) {
             quit = true;
 	  }
 	  else if (e.type == SDL_KEYDOWN) {
+	    // Remember when the press happened until its frame is shown. SDL
+	    // stamps even real key events when it pumps them, not when the
+	    // hardware saw them, so driver and OS delay are not included.
+	    if (gMeasureLatency) {
+	      gPendingPresses.push_back(e.key.timestamp);
+	    }
 	    // Select surfaces based on key press.
 	    switch(e.key.keysym.sym) {
 	    case SDLK_UP:
-	      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_UP];
+	      gCurrentSurface = keyPressSurface(KEY_PRESS_SURFACE_UP);
 	      break;
 	    case SDLK_DOWN:
-	      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DOWN];
+	      gCurrentSurface = keyPressSurface(KEY_PRESS_SURFACE_DOWN);
 	      break;
 	    case SDLK_LEFT:
-	      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_LEFT];
+	      gCurrentSurface = keyPressSurface(KEY_PRESS_SURFACE_LEFT);
 	      break;
 	    case SDLK_RIGHT:
-	      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_RIGHT];
+	      gCurrentSurface = keyPressSurface(KEY_PRESS_SURFACE_RIGHT);
 	      break;
 	    default:
-	      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT];
+	      gCurrentSurface = keyPressSurface(KEY_PRESS_SURFACE_DEFAULT);
 	      break;
 	    }
 	  }
 	}
-	// Apply the image.
-	SDL_BlitSurface(gCurrentSurface, NULL, gScreenSurface, NULL);
+	// Apply the image, keeping it last in line for eviction.
+	if (gCurrentSurface != NULL) {
+	  touchTrackedSurface(gCurrentSurface);
+	  if (gCurrentSurface->w == gScreenSurface->w && gCurrentSurface->h == gScreenSurface->h) {
+	    SDL_BlitSurface(gCurrentSurface, NULL, gScreenSurface, NULL);
+	  }
+	  else {
+	    // Stretch a downscaled fallback back to full size.
+	    SDL_BlitScaled(gCurrentSurface, NULL, gScreenSurface, NULL);
+	  }
+	}
 
 	// Update the surface.
 	SDL_UpdateWindowSurface(gWindow);
+	if (gMeasureLatency) {
+	  recordPresent(SDL_GetPerformanceCounter());
+	}
+      }
+
+      if (gInjectionTimer != 0) {
+	SDL_RemoveTimer(gInjectionTimer);
+	gInjectionTimer = 0;
+      }
+      if (gMeasureLatency) {
+	reportLatency();
       }
- 
     }
   }
   // Free resources and quit SDL.
@@ -122,7 +230,7 @@ bool init() {
   bool success = true;
 
   // Initialize SDL.
-  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+  if (SDL_Init(SDL_INIT_VIDEO | (gSyntheticInput ? SDL_INIT_TIMER : 0)) < 0) {
     std::cout << "SDL could not initialize! SDL_Error: " <<
       SDL_GetError() << "\n";
     success = false;
@@ -138,20 +246,53 @@ bool init() {
     }
     else {
       // Get window surface.
-      gScreenSurface = SDL_GetWindowSurface(gWindow);
+      gScreenSurface = trackSurface(SDL_GetWindowSurface(gWindow), "window",
+				    SURFACE_CATEGORY_SCREEN);
     }
   }
   return success;
 }
 
 SDL_Surface* loadSurface(std::string path) {
+  SDL_Surface* optimizedSurface = NULL;
+
   // Load image at specified path.
-  SDL_Surface* loadedSurface = SDL_LoadBMP(path.c_str());
+  SDL_Surface* loadedSurface = trackSurface(SDL_LoadBMP(path.c_str()), path,
+					    SURFACE_CATEGORY_TEMPORARY);
   if (loadedSurface == NULL) {
     std::cout << "Unable to load image: " << path << "! SDL_Error: " <<
       SDL_GetError() << "\n";
   }
-  return loadedSurface;
+  else {
+    // Convert surface to screen format, downscaled if over budget.
+    optimizedSurface = convertSurfaceWithinBudget(loadedSurface, gScreenSurface->format);
+    if (optimizedSurface == NULL) {
+      std::cout << "Unable to optimize image: " << path << "! SDL_Error: " <<
+	SDL_GetError() << "\n";
+    }
+    freeTrackedSurface(loadedSurface);
+  }
+  return optimizedSurface;
+}
+
+// Releases a key press image when the surface budget needs the memory.
+static void evictKeyPressSurface(SDL_Surface *surface, void *data) {
+  SDL_Surface **slot = (SDL_Surface**)data;
+  if (gCurrentSurface == surface) {
+    gCurrentSurface = NULL;
+  }
+  *slot = NULL;
+  freeTrackedSurface(surface);
+}
+
+SDL_Surface* keyPressSurface(int which) {
+  if (gKeyPressSurfaces[which] == NULL) {
+    gKeyPressSurfaces[which] = trackSurface(loadSurface(KEY_PRESS_PATHS[which]),
+					    KEY_PRESS_PATHS[which], SURFACE_CATEGORY_ASSET,
+					    evictKeyPressSurface, &gKeyPressSurfaces[which]);
+  }
+  touchTrackedSurface(gKeyPressSurfaces[which]);
+  return gKeyPressSurfaces[which];
 }
 
 bool loadMedia() {
@@ -159,36 +300,31 @@ bool loadMedia() {
   bool success = true;
 
   // Load default surface.
-  gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT] = loadSurface("04_key_presses/press.bmp");
-  if (gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT] == NULL) {
+  if (keyPressSurface(KEY_PRESS_SURFACE_DEFAULT) == NULL) {
     std::cout << "Failed to load default image!\n";
     success = false;
   }
 
   // Load up surface.
-  gKeyPressSurfaces[KEY_PRESS_SURFACE_UP] = loadSurface("04_key_presses/up.bmp");
-  if (gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT] == NULL) {
+  if (keyPressSurface(KEY_PRESS_SURFACE_UP) == NULL) {
     std::cout << "Failed to load up image!\n";
     success = false;
   }
 
   // Load down surface.
-  gKeyPressSurfaces[KEY_PRESS_SURFACE_DOWN] = loadSurface("04_key_presses/down.bmp");
-  if (gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT] == NULL) {
+  if (keyPressSurface(KEY_PRESS_SURFACE_DOWN) == NULL) {
     std::cout << "Failed to load down image!\n";
     success = false;
   }
 
   // Load left surface.
-  gKeyPressSurfaces[KEY_PRESS_SURFACE_LEFT] = loadSurface("04_key_presses/left.bmp");
-  if (gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT] == NULL) {
+  if (keyPressSurface(KEY_PRESS_SURFACE_LEFT) == NULL) {
     std::cout << "Failed to load left image!\n";
     success = false;
   }
 
   // Load right surface.
-  gKeyPressSurfaces[KEY_PRESS_SURFACE_RIGHT] = loadSurface("04_key_presses/right.bmp");
-  if (gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT] == NULL) {
+  if (keyPressSurface(KEY_PRESS_SURFACE_RIGHT) == NULL) {
     std::cout << "Failed to load right image!\n";
     success = false;
   }
@@ -196,12 +332,75 @@ bool loadMedia() {
   return success;
 }
 
+Uint32 injectKeyPress(Uint32, void *) {
+  if (gPressesInjected >= gSyntheticPresses) {
+    return 0;
+  }
+  const SDL_Keycode keys[] = { SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT };
+
+  // SDL_PushEvent stamps the event with the current tick.
+  SDL_Event event;
+  SDL_memset(&event, 0, sizeof(event));
+  event.type = SDL_KEYDOWN;
+  event.key.state = SDL_PRESSED;
+  event.key.windowID = gInjectionWindowID;
+  event.key.keysym.sym = keys[gPressesInjected % 4];
+  if (SDL_PushEvent(&event) == 1) {
+    gPressesInjected++;
+  }
+
+  // Vary the gap so that presses land at different points of the frame.
+  return 2 + rand() % 15;
+}
+
+void recordPresent(Uint64 presentCounter) {
+  double presentMs = gTicksOrigin + (double)(presentCounter - gCounterOrigin) * 1000.0 /
+    SDL_GetPerformanceFrequency();
+  for (size_t i = 0; i < gPendingPresses.size(); i++) {
+    gLatencies.push_back(presentMs - gPendingPresses[i]);
+  }
+  gPendingPresses.clear();
+}
+
+void reportLatency() {
+  if (gLatencies.empty()) {
+    std::cout << "No key presses measured.\n";
+    return;
+  }
+
+  std::vector<double> sorted(gLatencies);
+  std::sort(sorted.begin(), sorted.end());
+  int buckets[LATENCY_BUCKETS] = { 0 };
+  for (size_t i = 0; i < sorted.size(); i++) {
+    int bucket = std::max(0, (int)(sorted[i] / LATENCY_BUCKET_MS));
+    buckets[std::min(bucket, LATENCY_BUCKETS - 1)]++;
+  }
+
+  // Event timestamps are whole milliseconds, so each sample is only accurate
+  // to about 1 ms.
+  printf("Input-to-photon latency over %d presses (ms):\n", (int)sorted.size());
+  printf("  min %.2f  median %.2f  p95 %.2f  p99 %.2f  max %.2f\n", sorted.front(),
+	 sorted[sorted.size() / 2], sorted[sorted.size() * 95 / 100],
+	 sorted[sorted.size() * 99 / 100], sorted.back());
+  int largest = *std::max_element(buckets, buckets + LATENCY_BUCKETS);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    if (buckets[i] == 0) {
+      continue;
+    }
+    std::string bar(buckets[i] * 50 / largest + 1, '#');
+    printf("  %3d%s ms %6d %s\n", i * LATENCY_BUCKET_MS, i == LATENCY_BUCKETS - 1 ? "+" : " ",
+	   buckets[i], bar.c_str());
+  }
+}
+
 void close() {
   // Deallocate surfaces.
   for (int i = 0; i < KEY_PRESS_SURFACE_TOTAL; i++) {
-    SDL_FreeSurface(gKeyPressSurfaces[i]);
+    freeTrackedSurface(gKeyPressSurfaces[i]);
     gKeyPressSurfaces[i] = NULL;
   }
+  untrackSurface(gScreenSurface);
+  gScreenSurface = NULL;
 
   // Destroy window.
   SDL_DestroyWindow(gWindow);
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <string>
 
+#include "surface_registry.h"
+
 // --------------------
 // -------------------- Prototypes --------------------
 // --------------------
@@ -41,6 +43,9 @@ SDL_Surface *gStretchedSurface = NULL;
 // --------------------
 
 int main(int argc, char **argv) {
+  // Track surface memory against SURFACE_BUDGET_MB.
+  initSurfaceRegistry();
+
   // Start up SDL and create window.
   if (!init()) {
     std::cout << "Failed to initialize!\n";
@@ -57,6 +62,9 @@ int main(int argc, char **argv) {
       
       // While application is running.
       while (!quit) {
+	// Dump surface memory on SIGUSR1.
+	pollSurfaceRegistrySignal();
+
 	// Handle events on queue.
 	while (SDL_PollEvent(&e) != 0) {
 	  // User requests quit.
@@ -109,7 +117,8 @@ bool init() {
     }
     else {
       // Get window surface.
-      gScreenSurface = SDL_GetWindowSurface(gWindow);
+      gScreenSurface = trackSurface(SDL_GetWindowSurface(gWindow), "window",
+				    SURFACE_CATEGORY_SCREEN);
     }
   }
   return success;
@@ -119,19 +128,21 @@ SDL_Surface* loadSurface(std::string path) {
   SDL_Surface* optimizedSurface = NULL;
   
   // Load image at specified path.
-  SDL_Surface* loadedSurface = SDL_LoadBMP(path.c_str());
+  SDL_Surface* loadedSurface = trackSurface(SDL_LoadBMP(path.c_str()), path,
+					    SURFACE_CATEGORY_TEMPORARY);
   if (loadedSurface == NULL) {
     std::cout << "Unable to load image: " << path << "! SDL_Error: " <<
       SDL_GetError() << "\n";
   }
   else {
-    // Convert surface to screen format.
-    optimizedSurface = SDL_ConvertSurface(loadedSurface, gScreenSurface->format, NULL);
+    // Convert surface to screen format, downscaled if over budget.
+    optimizedSurface = trackSurface(convertSurfaceWithinBudget(loadedSurface, gScreenSurface->format),
+				    path, SURFACE_CATEGORY_ASSET);
     if (optimizedSurface == NULL) {
       std::cout << "Unable to optimize image: " << path << "! SDL_Error: " <<
 	SDL_GetError() << "\n";
     }
-    SDL_FreeSurface(loadedSurface);
+    freeTrackedSurface(loadedSurface);
   }
   return optimizedSurface;
 }
@@ -152,8 +163,10 @@ bool loadMedia() {
 
 void close() {
   // Deallocate surfaces.
-  SDL_FreeSurface(gStretchedSurface);
+  freeTrackedSurface(gStretchedSurface);
   gStretchedSurface = NULL;
+  untrackSurface(gScreenSurface);
+  gScreenSurface = NULL;
 
   // Destroy window.
   SDL_DestroyWindow(gWindow);
@@ -6,9 +6,13 @@
 #include <SDL_image.h>
 #endif
 
+#include <cctype>
 #include <cstdio>
 #include <iostream>
 #include <string>
+#include <vector>
+
+#include "surface_registry.h"
 
 // --------------------
 // -------------------- Prototypes --------------------
@@ -22,6 +26,17 @@ bool loadMedia();
 void close();
 // Loads individual image.
 SDL_Surface* loadSurface(std::string path);
+// Starts reading and decoding the asset list on a background thread.
+bool startAssetLoad();
+// Waits for the background loader to finish.
+void finishAssetLoad();
+// Returns the SDL_image codecs needed by the asset list.
+int assetImageFlags();
+// Records the start and end of a startup phase.
+void beginPhase(int phase);
+void endPhase(int phase);
+// Prints the startup phase timings.
+void reportPhases();
 
 // --------------------
 // -------------------- Globals --------------------
@@ -38,11 +53,66 @@ SDL_Surface *gScreenSurface = NULL;
 // Current displayed image.
 SDL_Surface *gStretchedSurface = NULL;
 
+// Assets decoded at startup.
+enum Assets {
+	     ASSET_LOADED,
+	     ASSET_TOTAL,
+};
+const char *ASSET_PATHS[ASSET_TOTAL] = {
+  "06_extension_libraries_and_loading_other_image_formats/loaded.png",
+};
+// Decoded assets, not yet converted to the screen format.
+SDL_Surface *gDecodedAssets[ASSET_TOTAL];
+// Thread reading and decoding the assets.
+SDL_Thread *gAssetThread = NULL;
+
+// Startup phases, timed from process start to the first presented frame.
+enum StartupPhases {
+		    PHASE_SDL_INIT,
+		    PHASE_CREATE_WINDOW,
+		    PHASE_GET_WINDOW_SURFACE,
+		    PHASE_IMG_INIT,
+		    PHASE_READ_ASSETS,
+		    PHASE_DECODE_ASSETS,
+		    PHASE_WAIT_ASSETS,
+		    PHASE_CONVERT_ASSETS,
+		    PHASE_FIRST_FRAME,
+		    PHASE_TOTAL,
+};
+const char *PHASE_NAMES[PHASE_TOTAL] = {
+  "SDL_Init",
+  "SDL_CreateWindow",
+  "SDL_GetWindowSurface",
+  "IMG_Init (loader)",
+  "read assets (loader)",
+  "decode assets (loader)",
+  "wait for loader",
+  "convert assets",
+  "first frame",
+};
+// Performance counter at process start and at each phase boundary. Each
+// phase is written by one thread only.
+Uint64 gProcessStart = 0;
+Uint64 gPhaseStart[PHASE_TOTAL];
+Uint64 gPhaseEnd[PHASE_TOTAL];
+// Set once a phase has ended; phases skipped after a failure stay false.
+bool gPhaseRan[PHASE_TOTAL];
+
 // --------------------
 // -------------------- Main --------------------
 // --------------------
 
 int main(int argc, char **argv) {
+  gProcessStart = SDL_GetPerformanceCounter();
+
+  // Track surface memory against SURFACE_BUDGET_MB.
+  initSurfaceRegistry();
+
+  // Read and decode the assets while the window is being created.
+  if (!startAssetLoad()) {
+    std::cout << "Failed to start asset loader!\n";
+  }
+
   // Start up SDL and create window.
   if (!init()) {
     std::cout << "Failed to initialize!\n";
@@ -56,9 +126,14 @@ int main(int argc, char **argv) {
       bool quit = false;
       // Event handler.
       SDL_Event e;
+      // Whether the startup report is still due.
+      bool firstFrame = true;
       
       // While application is running.
       while (!quit) {
+	// Dump surface memory on SIGUSR1.
+	pollSurfaceRegistrySignal();
+
 	// Handle events on queue.
 	while (SDL_PollEvent(&e) != 0) {
 	  // User requests quit.
@@ -75,7 +150,15 @@ int main(int argc, char **argv) {
 	SDL_BlitScaled(gStretchedSurface, NULL, gScreenSurface, &stretchRect);
 
 	// Update the surface.
+	if (firstFrame) {
+	  beginPhase(PHASE_FIRST_FRAME);
+	}
 	SDL_UpdateWindowSurface(gWindow);
+	if (firstFrame) {
+	  endPhase(PHASE_FIRST_FRAME);
+	  reportPhases();
+	  firstFrame = false;
+	}
       }
  
     }
@@ -95,55 +178,173 @@ bool init() {
   bool success = true;
 
   // Initialize SDL.
-  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+  beginPhase(PHASE_SDL_INIT);
+  int sdlResult = SDL_Init(SDL_INIT_VIDEO);
+  endPhase(PHASE_SDL_INIT);
+  if (sdlResult < 0) {
     std::cout << "SDL could not initialize! SDL_Error: " <<
       SDL_GetError() << "\n";
     success = false;
   }
   else {
     // Create window.
+    beginPhase(PHASE_CREATE_WINDOW);
     gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED,
 			      SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,
 			      SDL_WINDOW_SHOWN);
+    endPhase(PHASE_CREATE_WINDOW);
     if (gWindow == NULL) {
       std::cout << "Window could not be created! SDL_Error: " <<
 	SDL_GetError() << "\n";
       success = false;
     }
     else {
-      // Initialize PNG loading.
-      int imgFlags = IMG_INIT_PNG;
-      if (!(IMG_Init(imgFlags) & imgFlags)) {
-	std::cout << "SDL_Image could not initialize! SDL_Image error: " <<
-	  IMG_GetError() << "\n";
-	success = false;
-      }
-      else {
-	// Get window surface.
-	gScreenSurface = SDL_GetWindowSurface(gWindow);
-      }
+      // Get window surface. SDL_image is initialized by the asset loader.
+      beginPhase(PHASE_GET_WINDOW_SURFACE);
+      gScreenSurface = trackSurface(SDL_GetWindowSurface(gWindow), "window",
+				    SURFACE_CATEGORY_SCREEN);
+      endPhase(PHASE_GET_WINDOW_SURFACE);
     }
   }
   return success;
 }
 
+int assetImageFlags() {
+  int imgFlags = 0;
+  for (int i = 0; i < ASSET_TOTAL; i++) {
+    std::string path = ASSET_PATHS[i];
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    for (size_t j = 0; j < extension.size(); j++) {
+      extension[j] = tolower(extension[j]);
+    }
+    if (extension == "png") {
+      imgFlags |= IMG_INIT_PNG;
+    }
+    else if (extension == "jpg" || extension == "jpeg") {
+      imgFlags |= IMG_INIT_JPG;
+    }
+    else if (extension == "tif" || extension == "tiff") {
+      imgFlags |= IMG_INIT_TIF;
+    }
+    else if (extension == "webp") {
+      imgFlags |= IMG_INIT_WEBP;
+    }
+  }
+  return imgFlags;
+}
+
+static int assetLoader(void *data) {
+  // Initialize only the codecs the assets use.
+  beginPhase(PHASE_IMG_INIT);
+  int imgFlags = assetImageFlags();
+  bool imgReady = (IMG_Init(imgFlags) & imgFlags) == imgFlags;
+  endPhase(PHASE_IMG_INIT);
+  if (!imgReady) {
+    std::cout << "SDL_Image could not initialize! SDL_Image error: " <<
+      IMG_GetError() << "\n";
+    return -1;
+  }
+
+  // Read every file first so that the I/O and decode costs show separately.
+  std::vector<std::vector<char> > files(ASSET_TOTAL);
+  beginPhase(PHASE_READ_ASSETS);
+  for (int i = 0; i < ASSET_TOTAL; i++) {
+    SDL_RWops *file = SDL_RWFromFile(ASSET_PATHS[i], "rb");
+    if (file == NULL) {
+      continue;
+    }
+    Sint64 size = SDL_RWsize(file);
+    if (size > 0) {
+      files[i].resize(size);
+      if (SDL_RWread(file, &files[i][0], size, 1) != 1) {
+	files[i].clear();
+      }
+    }
+    SDL_RWclose(file);
+  }
+  endPhase(PHASE_READ_ASSETS);
+
+  beginPhase(PHASE_DECODE_ASSETS);
+  for (int i = 0; i < ASSET_TOTAL; i++) {
+    if (!files[i].empty()) {
+      gDecodedAssets[i] = IMG_Load_RW(SDL_RWFromConstMem(&files[i][0], files[i].size()), 1);
+    }
+  }
+  endPhase(PHASE_DECODE_ASSETS);
+  return 0;
+}
+
+bool startAssetLoad() {
+  for (int i = 0; i < ASSET_TOTAL; i++) {
+    gDecodedAssets[i] = NULL;
+  }
+  gAssetThread = SDL_CreateThread(assetLoader, "AssetLoader", NULL);
+  return gAssetThread != NULL;
+}
+
+void finishAssetLoad() {
+  beginPhase(PHASE_WAIT_ASSETS);
+  if (gAssetThread != NULL) {
+    SDL_WaitThread(gAssetThread, NULL);
+    gAssetThread = NULL;
+  }
+  endPhase(PHASE_WAIT_ASSETS);
+}
+
+void beginPhase(int phase) {
+  gPhaseStart[phase] = SDL_GetPerformanceCounter();
+}
+
+void endPhase(int phase) {
+  gPhaseEnd[phase] = SDL_GetPerformanceCounter();
+  gPhaseRan[phase] = true;
+}
+
+void reportPhases() {
+  double msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+  printf("%-24s %10s %10s\n", "phase", "start ms", "took ms");
+  for (int i = 0; i < PHASE_TOTAL; i++) {
+    if (!gPhaseRan[i]) {
+      printf("%-24s %10s %10s\n", PHASE_NAMES[i], "not run", "-");
+      continue;
+    }
+    printf("%-24s %10.2f %10.2f\n", PHASE_NAMES[i],
+	   (gPhaseStart[i] - gProcessStart) * msPerTick,
+	   (gPhaseEnd[i] - gPhaseStart[i]) * msPerTick);
+  }
+  printf("%-24s %10.2f\n", "start to first frame",
+	 (gPhaseEnd[PHASE_FIRST_FRAME] - gProcessStart) * msPerTick);
+}
+
 SDL_Surface* loadSurface(std::string path) {
   SDL_Surface* optimizedSurface = NULL;
   
-  // Load image at specified path.
-  SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+  // Take the image decoded by the loader, or load it now if the loader
+  // did not produce it.
+  SDL_Surface* loadedSurface = NULL;
+  for (int i = 0; i < ASSET_TOTAL; i++) {
+    if (path == ASSET_PATHS[i]) {
+      loadedSurface = gDecodedAssets[i];
+      gDecodedAssets[i] = NULL;
+    }
+  }
+  if (loadedSurface == NULL) {
+    loadedSurface = IMG_Load(path.c_str());
+  }
+  trackSurface(loadedSurface, path, SURFACE_CATEGORY_TEMPORARY);
   if (loadedSurface == NULL) {
     std::cout << "Unable to load image: " << path << "! SDL_image Error: " <<
       IMG_GetError() << "\n";
   }
   else {
-    // Convert surface to screen format.
-    optimizedSurface = SDL_ConvertSurface(loadedSurface, gScreenSurface->format, 0);
+    // Convert surface to screen format, downscaled if over budget.
+    optimizedSurface = trackSurface(convertSurfaceWithinBudget(loadedSurface, gScreenSurface->format),
+				    path, SURFACE_CATEGORY_ASSET);
     if (optimizedSurface == NULL) {
       std::cout << "Unable to optimize image: " << path << "! SDL_Error: " <<
 	SDL_GetError() << "\n";
     }
-    SDL_FreeSurface(loadedSurface);
+    freeTrackedSurface(loadedSurface);
   }
   return optimizedSurface;
 }
@@ -152,8 +353,11 @@ bool loadMedia() {
   // Loading success flag.
   bool success = true;
 
-  // Load default surface.
-  gStretchedSurface = loadSurface("06_extension_libraries_and_loading_other_image_formats/loaded.png");
+  // Wait for the decoded assets, then convert them to the screen format.
+  finishAssetLoad();
+  beginPhase(PHASE_CONVERT_ASSETS);
+  gStretchedSurface = loadSurface(ASSET_PATHS[ASSET_LOADED]);
+  endPhase(PHASE_CONVERT_ASSETS);
   if (gStretchedSurface == NULL) {
     std::cout << "Failed to load image to stretch!\n";
     success = false;
@@ -163,14 +367,24 @@ bool loadMedia() {
 }
 
 void close() {
+  // Make sure the loader is done if init() failed.
+  finishAssetLoad();
+
   // Deallocate surfaces.
-  SDL_FreeSurface(gStretchedSurface);
+  freeTrackedSurface(gStretchedSurface);
   gStretchedSurface = NULL;
+  untrackSurface(gScreenSurface);
+  gScreenSurface = NULL;
+  for (int i = 0; i < ASSET_TOTAL; i++) {
+    SDL_FreeSurface(gDecodedAssets[i]);
+    gDecodedAssets[i] = NULL;
+  }
 
   // Destroy window.
   SDL_DestroyWindow(gWindow);
   gWindow = NULL;
 
-  // Quit SDL.
+  // Quit SDL subsystems.
+  IMG_Quit();
   SDL_Quit();	  
 }
@@ -0,0 +1,484 @@
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#else
+#include <SDL.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// A single queued draw call.
+struct SpriteDraw {
+  // Surface the sprite is cut from.
+  SDL_Surface *source;
+  // Region of the source to draw.
+  SDL_Rect srcRect;
+  // Position on the target; w and h match srcRect (no scaling).
+  SDL_Rect dstRect;
+  // Blend mode applied to the source for this draw.
+  SDL_BlendMode blendMode;
+  // Draw order between layers; lower layers are drawn first.
+  int layer;
+};
+
+// Per-frame counters reported by the sprite layer.
+struct SpriteBatchStats {
+  int submitted;
+  int culled;
+  int drawn;
+  int batches;
+};
+
+// A moving sprite in the demo scene.
+struct Sprite {
+  float x, y;
+  float dx, dy;
+  int sheet;
+  int frame;
+  int layer;
+};
+
+// Starts up SDL and creates window.
+bool init();
+// Loads media.
+bool loadMedia();
+// Frees Media and shuts down SDL.
+void close();
+// Loads individual image.
+SDL_Surface* loadSurface(std::string path);
+
+// Clears the sprite queue for a new frame.
+void beginSprites();
+// Queues a sprite for drawing at the end of the frame.
+void drawSprite(SDL_Surface *source, const SDL_Rect &srcRect, int x, int y,
+		SDL_BlendMode blendMode, int layer);
+// Culls, sorts and blits all queued sprites to target.
+SpriteBatchStats flushSprites(SDL_Surface *target);
+// Blits all queued sprites one by one in submission order.
+SpriteBatchStats flushSpritesUnbatched(SDL_Surface *target);
+
+// Fills gSprites with count sprites at random positions.
+void spawnSprites(int count);
+// Moves every sprite and queues it for drawing.
+void updateSprites();
+// Runs the stress benchmark and prints throughput per sprite count.
+void runBenchmark();
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// Sprite sheet constants.
+enum SpriteSheets {
+		   SPRITE_SHEET_PRESS,
+		   SPRITE_SHEET_UP,
+		   SPRITE_SHEET_DOWN,
+		   SPRITE_SHEET_LEFT,
+		   SPRITE_SHEET_RIGHT,
+		   SPRITE_SHEET_TOTAL,
+};
+
+// Window size.
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+
+// Sprite cell size within a sheet.
+const int SPRITE_SIZE = 32;
+// Sprites wander this far outside the screen so that culling has work to do.
+const int SPRITE_MARGIN = 128;
+// Number of sprites in the interactive demo.
+const int DEFAULT_SPRITE_COUNT = 2000;
+// Frames rendered per benchmark run.
+const int BENCHMARK_FRAMES = 100;
+
+// The window we will render to.
+SDL_Window *gWindow = NULL;
+// The surface contained by the window.
+SDL_Surface *gScreenSurface = NULL;
+// Sheets the sprites are cut from.
+SDL_Surface *gSpriteSheets[SPRITE_SHEET_TOTAL];
+
+// Draw calls collected during the current frame.
+std::vector<SpriteDraw> gSpriteQueue;
+// Sprites in the scene.
+std::vector<Sprite> gSprites;
+
+// --------------------
+// -------------------- Main --------------------
+// --------------------
+
+int main(int argc, char **argv) {
+  // Start up SDL and create window.
+  if (!init()) {
+    std::cout << "Failed to initialize!\n";
+  }
+  else {
+    if (!loadMedia()) {
+      std::cout << "Failed to load media!\n";
+    }
+    else if (argc > 1 && std::string(argv[1]) == "--bench") {
+      runBenchmark();
+    }
+    else {
+      // Main loop flag.
+      bool quit = false;
+      // Event handler.
+      SDL_Event e;
+      // Toggles between batched and unbatched blitting.
+      bool batched = true;
+      // Frame timing for the title bar.
+      Uint32 lastReport = SDL_GetTicks();
+      int frames = 0;
+
+      spawnSprites(DEFAULT_SPRITE_COUNT);
+
+      // While application is running.
+      while (!quit) {
+	// Handle events on queue.
+	while (SDL_PollEvent(&e) != 0) {
+	  // User requests quit.
+	  if (e.type == SDL_QUIT) {
+	    quit = true;
+	  }
+	  else if (e.type == SDL_KEYDOWN) {
+	    switch(e.key.keysym.sym) {
+	    case SDLK_SPACE:
+	      batched = !batched;
+	      break;
+	    case SDLK_UP:
+	      spawnSprites(gSprites.size() * 2);
+	      break;
+	    case SDLK_DOWN:
+	      spawnSprites(std::max<int>(1, gSprites.size() / 2));
+	      break;
+	    default:
+	      break;
+	    }
+	  }
+	}
+	// Clear the screen and draw the sprites.
+	SDL_FillRect(gScreenSurface, NULL, SDL_MapRGB(gScreenSurface->format, 0, 0, 0));
+	beginSprites();
+	updateSprites();
+	SpriteBatchStats stats = batched ? flushSprites(gScreenSurface) :
+	  flushSpritesUnbatched(gScreenSurface);
+
+	// Update the surface.
+	SDL_UpdateWindowSurface(gWindow);
+
+	// Report frame rate once a second.
+	frames++;
+	Uint32 now = SDL_GetTicks();
+	if (now - lastReport >= 1000) {
+	  char title[128];
+	  snprintf(title, sizeof(title), "%s: %d sprites, %d drawn, %d batches, %d fps",
+		   batched ? "Batched" : "Unbatched", stats.submitted, stats.drawn,
+		   stats.batches, frames * 1000 / (int)(now - lastReport));
+	  SDL_SetWindowTitle(gWindow, title);
+	  lastReport = now;
+	  frames = 0;
+	}
+      }
+
+    }
+  }
+  // Free resources and quit SDL.
+  close();
+
+  return 0;
+}
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+bool init() {
+  // Initialization flag.
+  bool success = true;
+
+  // Initialize SDL.
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    std::cout << "SDL could not initialize! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    success = false;
+  }
+  else {
+    // Create window.
+    gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED,
+			      SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,
+			      SDL_WINDOW_SHOWN);
+    if (gWindow == NULL) {
+      std::cout << "Window could not be created! SDL_Error: " <<
+	SDL_GetError() << "\n";
+      success = false;
+    }
+    else {
+      // Get window surface.
+      gScreenSurface = SDL_GetWindowSurface(gWindow);
+    }
+  }
+  return success;
+}
+
+SDL_Surface* loadSurface(std::string path) {
+  SDL_Surface* optimizedSurface = NULL;
+
+  // Load image at specified path.
+  SDL_Surface* loadedSurface = SDL_LoadBMP(path.c_str());
+  if (loadedSurface == NULL) {
+    std::cout << "Unable to load image: " << path << "! SDL_Error: " <<
+      SDL_GetError() << "\n";
+  }
+  else {
+    // Convert surface to screen format.
+    optimizedSurface = SDL_ConvertSurface(loadedSurface, gScreenSurface->format, 0);
+    if (optimizedSurface == NULL) {
+      std::cout << "Unable to optimize image: " << path << "! SDL_Error: " <<
+	SDL_GetError() << "\n";
+    }
+    SDL_FreeSurface(loadedSurface);
+  }
+  return optimizedSurface;
+}
+
+bool loadMedia() {
+  // Loading success flag.
+  bool success = true;
+
+  // Reuse the key press images as sprite sheets.
+  const char *paths[SPRITE_SHEET_TOTAL] = {
+    "04_key_presses/press.bmp",
+    "04_key_presses/up.bmp",
+    "04_key_presses/down.bmp",
+    "04_key_presses/left.bmp",
+    "04_key_presses/right.bmp",
+  };
+  for (int i = 0; i < SPRITE_SHEET_TOTAL; i++) {
+    gSpriteSheets[i] = loadSurface(paths[i]);
+    if (gSpriteSheets[i] == NULL) {
+      std::cout << "Failed to load sprite sheet!\n";
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+void close() {
+  // Deallocate surfaces.
+  for (int i = 0; i < SPRITE_SHEET_TOTAL; i++) {
+    SDL_FreeSurface(gSpriteSheets[i]);
+    gSpriteSheets[i] = NULL;
+  }
+
+  // Destroy window.
+  SDL_DestroyWindow(gWindow);
+  gWindow = NULL;
+
+  // Quit SDL.
+  SDL_Quit();
+}
+
+void beginSprites() {
+  // Keep the capacity so steady-state frames do not allocate.
+  gSpriteQueue.clear();
+}
+
+void drawSprite(SDL_Surface *source, const SDL_Rect &srcRect, int x, int y,
+		SDL_BlendMode blendMode, int layer) {
+  SpriteDraw draw;
+  draw.source = source;
+  draw.srcRect = srcRect;
+  draw.dstRect.x = x;
+  draw.dstRect.y = y;
+  draw.dstRect.w = srcRect.w;
+  draw.dstRect.h = srcRect.h;
+  draw.blendMode = blendMode;
+  draw.layer = layer;
+  gSpriteQueue.push_back(draw);
+}
+
+// Orders draws by layer first so overlap between layers is preserved, then
+// groups draws sharing a source and blend mode into one batch.
+static bool spriteDrawLess(const SpriteDraw &a, const SpriteDraw &b) {
+  if (a.layer != b.layer) {
+    return a.layer < b.layer;
+  }
+  if (a.source != b.source) {
+    return a.source < b.source;
+  }
+  return a.blendMode < b.blendMode;
+}
+
+SpriteBatchStats flushSprites(SDL_Surface *target) {
+  SpriteBatchStats stats;
+  stats.submitted = gSpriteQueue.size();
+  stats.culled = 0;
+  stats.drawn = 0;
+  stats.batches = 0;
+
+  // Cull and clip every draw against its source bounds and the target clip
+  // rect, computed once here so that the blits below can skip SDL's own
+  // per-call clipping.
+  SDL_Rect clip = target->clip_rect;
+  size_t kept = 0;
+  for (size_t i = 0; i < gSpriteQueue.size(); i++) {
+    SpriteDraw draw = gSpriteQueue[i];
+    SDL_Rect bounds = { 0, 0, draw.source->w, draw.source->h };
+    SDL_Rect inside;
+    if (!SDL_IntersectRect(&draw.srcRect, &bounds, &inside)) {
+      stats.culled++;
+      continue;
+    }
+    // Shift the target rect by however much was clipped off the source.
+    draw.dstRect.x += inside.x - draw.srcRect.x;
+    draw.dstRect.y += inside.y - draw.srcRect.y;
+    draw.dstRect.w = inside.w;
+    draw.dstRect.h = inside.h;
+    draw.srcRect = inside;
+
+    SDL_Rect visible;
+    if (!SDL_IntersectRect(&draw.dstRect, &clip, &visible)) {
+      stats.culled++;
+      continue;
+    }
+    // Shift the source rect by however much was clipped off the target.
+    draw.srcRect.x += visible.x - draw.dstRect.x;
+    draw.srcRect.y += visible.y - draw.dstRect.y;
+    draw.srcRect.w = visible.w;
+    draw.srcRect.h = visible.h;
+    draw.dstRect = visible;
+    gSpriteQueue[kept++] = draw;
+  }
+  gSpriteQueue.resize(kept);
+
+  // Stable so that draws within a batch keep their submission order.
+  std::stable_sort(gSpriteQueue.begin(), gSpriteQueue.end(), spriteDrawLess);
+
+  size_t i = 0;
+  while (i < gSpriteQueue.size()) {
+    SDL_Surface *source = gSpriteQueue[i].source;
+    SDL_BlendMode blendMode = gSpriteQueue[i].blendMode;
+    int layer = gSpriteQueue[i].layer;
+
+    // Changing the blend mode invalidates the source's blit map, so do it
+    // once per batch rather than once per sprite.
+    SDL_SetSurfaceBlendMode(source, blendMode);
+    for (; i < gSpriteQueue.size(); i++) {
+      SpriteDraw &draw = gSpriteQueue[i];
+      if (draw.source != source || draw.blendMode != blendMode ||
+	  draw.layer != layer) {
+	break;
+      }
+      // Rects are already clipped, so go straight to the low-level blit.
+      SDL_LowerBlit(source, &draw.srcRect, target, &draw.dstRect);
+      stats.drawn++;
+    }
+    stats.batches++;
+  }
+  return stats;
+}
+
+SpriteBatchStats flushSpritesUnbatched(SDL_Surface *target) {
+  SpriteBatchStats stats;
+  stats.submitted = gSpriteQueue.size();
+  stats.culled = 0;
+  stats.drawn = 0;
+  stats.batches = 0;
+
+  // The naive path: one fully-checked blit per sprite, in submission order.
+  for (size_t i = 0; i < gSpriteQueue.size(); i++) {
+    SpriteDraw &draw = gSpriteQueue[i];
+    SDL_SetSurfaceBlendMode(draw.source, draw.blendMode);
+    SDL_BlitSurface(draw.source, &draw.srcRect, target, &draw.dstRect);
+    stats.drawn++;
+    stats.batches++;
+  }
+  return stats;
+}
+
+void spawnSprites(int count) {
+  // Same seed every time so benchmark runs are comparable.
+  std::srand(1);
+  gSprites.resize(count);
+  for (int i = 0; i < count; i++) {
+    Sprite &sprite = gSprites[i];
+    sprite.x = std::rand() % (SCREEN_WIDTH + 2 * SPRITE_MARGIN) - SPRITE_MARGIN;
+    sprite.y = std::rand() % (SCREEN_HEIGHT + 2 * SPRITE_MARGIN) - SPRITE_MARGIN;
+    sprite.dx = (std::rand() % 5) - 2;
+    sprite.dy = (std::rand() % 5) - 2;
+    sprite.sheet = std::rand() % SPRITE_SHEET_TOTAL;
+    sprite.frame = std::rand() % 16;
+    sprite.layer = std::rand() % 2;
+  }
+}
+
+void updateSprites() {
+  for (size_t i = 0; i < gSprites.size(); i++) {
+    Sprite &sprite = gSprites[i];
+
+    // Move and wrap around the area just outside the screen.
+    sprite.x += sprite.dx;
+    sprite.y += sprite.dy;
+    if (sprite.x < -SPRITE_MARGIN) sprite.x += SCREEN_WIDTH + 2 * SPRITE_MARGIN;
+    if (sprite.x > SCREEN_WIDTH + SPRITE_MARGIN) sprite.x -= SCREEN_WIDTH + 2 * SPRITE_MARGIN;
+    if (sprite.y < -SPRITE_MARGIN) sprite.y += SCREEN_HEIGHT + 2 * SPRITE_MARGIN;
+    if (sprite.y > SCREEN_HEIGHT + SPRITE_MARGIN) sprite.y -= SCREEN_HEIGHT + 2 * SPRITE_MARGIN;
+
+    // Cut a cell out of the top-left of the sheet.
+    SDL_Rect cell;
+    cell.x = (sprite.frame % 4) * SPRITE_SIZE;
+    cell.y = (sprite.frame / 4) * SPRITE_SIZE;
+    cell.w = SPRITE_SIZE;
+    cell.h = SPRITE_SIZE;
+
+    // Top layer sprites are additive so the blend mode grouping is exercised.
+    SDL_BlendMode blendMode = sprite.layer == 0 ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_ADD;
+    drawSprite(gSpriteSheets[sprite.sheet], cell, (int)sprite.x, (int)sprite.y,
+	       blendMode, sprite.layer);
+  }
+}
+
+void runBenchmark() {
+  const int counts[] = { 1000, 10000, 100000 };
+  const int numCounts = sizeof(counts) / sizeof(counts[0]);
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+
+  std::cout << "sprites\tmode\tms/frame\tsprites/s\tdrawn\tbatches\n";
+  for (int c = 0; c < numCounts; c++) {
+    for (int mode = 0; mode < 2; mode++) {
+      bool batched = mode == 0;
+      SpriteBatchStats stats;
+      spawnSprites(counts[c]);
+
+      Uint64 start = SDL_GetPerformanceCounter();
+      for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+	SDL_FillRect(gScreenSurface, NULL, 0);
+	beginSprites();
+	updateSprites();
+	stats = batched ? flushSprites(gScreenSurface) :
+	  flushSpritesUnbatched(gScreenSurface);
+	SDL_UpdateWindowSurface(gWindow);
+
+	// Keep the window responsive during long runs.
+	SDL_PumpEvents();
+      }
+      Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+
+      double seconds = (double)elapsed / frequency;
+      double msPerFrame = seconds * 1000.0 / BENCHMARK_FRAMES;
+      double spritesPerSecond = (double)counts[c] * BENCHMARK_FRAMES / seconds;
+      std::cout << counts[c] << "\t" << (batched ? "batched" : "naive") << "\t" <<
+	msPerFrame << "\t" << (long)spritesPerSecond << "\t" << stats.drawn << "\t" <<
+	stats.batches << "\n";
+    }
+  }
+}
@@ -0,0 +1,774 @@
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#include <SDL2_image/SDL_image.h>
+#else
+#include <SDL.h>
+#include <SDL_image.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// Identifies one tile of the pyramid. Level 0 is full resolution and every
+// following level halves both dimensions.
+struct TileKey {
+  int level;
+  int row;
+  int col;
+
+  bool operator<(const TileKey &other) const {
+    if (level != other.level) return level < other.level;
+    if (row != other.row) return row < other.row;
+    return col < other.col;
+  }
+  bool operator==(const TileKey &other) const {
+    return level == other.level && row == other.row && col == other.col;
+  }
+};
+
+// A resident tile.
+struct CachedTile {
+  SDL_Surface *surface;
+  // Position in gLruList, most recently used at the front.
+  std::list<TileKey>::iterator lruPosition;
+  // Frame in which the tile was last drawn; tiles drawn this frame are
+  // never evicted.
+  Uint32 lastUsedFrame;
+};
+
+// Describes a preprocessed tile pyramid.
+struct TiledImage {
+  std::string directory;
+  int width;
+  int height;
+  int tileSize;
+  int levels;
+};
+
+// Starts up SDL and creates window.
+bool init();
+// Frees Media and shuts down SDL.
+void close();
+
+// Cuts source into a tile pyramid stored in directory.
+bool buildTiles(std::string source, std::string directory);
+// Reads the pyramid description from directory.
+bool loadTiledImage(std::string directory);
+
+// Width and height of the image at the given level.
+int levelWidth(int level);
+int levelHeight(int level);
+// File holding a tile.
+std::string tilePath(const std::string &directory, const TileKey &key);
+
+// Starts and stops the background tile loader.
+bool startLoader();
+void stopLoader();
+// Replaces the loader queue with the tiles needed next.
+void requestTiles(const std::vector<TileKey> &keys);
+// Moves tiles finished by the loader into the cache.
+void collectLoadedTiles();
+// Returns a resident tile and marks it used, or NULL.
+SDL_Surface* findTile(const TileKey &key);
+// Evicts least recently used tiles until the cache fits its budget.
+void trimCache();
+// Draws the visible part of the current level and queues missing tiles.
+void renderViewport(float panX, float panY);
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// Window size.
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+
+// Edge length of a tile in pixels.
+const int TILE_SIZE = 256;
+// Bytes of tile pixels the cache may keep resident.
+const size_t CACHE_BUDGET_BYTES = 64 * 1024 * 1024;
+// Tiles to prefetch beyond the viewport in the pan direction.
+const int PREFETCH_TILES = 2;
+// Pan speed in screen pixels per second.
+const float PAN_SPEED = 600.0f;
+
+// Demo source and tile directory used when no arguments are given.
+const char *DEFAULT_SOURCE = "06_extension_libraries_and_loading_other_image_formats/loaded.png";
+const char *DEFAULT_TILE_DIRECTORY = "08_tiled_virtual_images";
+
+// The window we will render to.
+SDL_Window *gWindow = NULL;
+// The surface contained by the window.
+SDL_Surface *gScreenSurface = NULL;
+
+// The pyramid being viewed.
+TiledImage gImage;
+// Currently displayed level.
+int gLevel = 0;
+// Viewport centre in level 0 pixels.
+float gCenterX = 0;
+float gCenterY = 0;
+// Frame counter used for cache pinning.
+Uint32 gFrame = 0;
+
+// Resident tiles and their use order.
+std::map<TileKey, CachedTile> gTileCache;
+std::list<TileKey> gLruList;
+// Pixel bytes held by gTileCache.
+size_t gCacheBytes = 0;
+// Cache statistics.
+int gCacheHits = 0;
+int gCacheMisses = 0;
+int gCacheEvictions = 0;
+
+// Loader thread state, guarded by gLoaderMutex.
+SDL_Thread *gLoaderThread = NULL;
+SDL_mutex *gLoaderMutex = NULL;
+SDL_cond *gLoaderCond = NULL;
+bool gLoaderQuit = false;
+// Tiles waiting to be loaded, most urgent first.
+std::deque<TileKey> gPendingTiles;
+// Tiles queued or being loaded, so they are not requested twice.
+std::set<TileKey> gInFlightTiles;
+// Tiles loaded but not yet handed to the cache.
+std::vector<std::pair<TileKey, SDL_Surface*> > gLoadedTiles;
+
+// --------------------
+// -------------------- Main --------------------
+// --------------------
+
+int main(int argc, char **argv) {
+  // Preprocessing only needs the video subsystem for surface conversion.
+  if (argc == 4 && std::string(argv[1]) == "--build") {
+    if (SDL_Init(SDL_INIT_VIDEO) < 0 || !(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
+      std::cout << "SDL could not initialize! SDL_Error: " << SDL_GetError() << "\n";
+      return 1;
+    }
+    bool built = buildTiles(argv[2], argv[3]);
+    IMG_Quit();
+    SDL_Quit();
+    return built ? 0 : 1;
+  }
+
+  std::string directory = argc > 1 ? argv[1] : DEFAULT_TILE_DIRECTORY;
+
+  // Start up SDL and create window.
+  if (!init()) {
+    std::cout << "Failed to initialize!\n";
+  }
+  else {
+    // Build the demo pyramid on first run.
+    if (!loadTiledImage(directory) && argc == 1) {
+      std::cout << "Building tiles for " << DEFAULT_SOURCE << "\n";
+      buildTiles(DEFAULT_SOURCE, directory);
+    }
+    if (!loadTiledImage(directory)) {
+      std::cout << "Failed to load tiled image from " << directory << "!\n";
+    }
+    else if (!startLoader()) {
+      std::cout << "Failed to start tile loader!\n";
+    }
+    else {
+      // Main loop flag.
+      bool quit = false;
+      // Event handler.
+      SDL_Event e;
+      Uint32 lastTicks = SDL_GetTicks();
+      Uint32 lastReport = lastTicks;
+
+      gCenterX = gImage.width / 2.0f;
+      gCenterY = gImage.height / 2.0f;
+
+      // While application is running.
+      while (!quit) {
+	// Handle events on queue.
+	while (SDL_PollEvent(&e) != 0) {
+	  // User requests quit.
+	  if (e.type == SDL_QUIT) {
+	    quit = true;
+	  }
+	  else if (e.type == SDL_KEYDOWN) {
+	    switch(e.key.keysym.sym) {
+	    case SDLK_EQUALS:
+	    case SDLK_PLUS:
+	      if (gLevel > 0) gLevel--;
+	      break;
+	    case SDLK_MINUS:
+	      if (gLevel < gImage.levels - 1) gLevel++;
+	      break;
+	    default:
+	      break;
+	    }
+	  }
+	}
+
+	// Pan with the arrow keys at a constant screen speed.
+	Uint32 ticks = SDL_GetTicks();
+	float seconds = (ticks - lastTicks) / 1000.0f;
+	lastTicks = ticks;
+	const Uint8 *keys = SDL_GetKeyboardState(NULL);
+	float panX = (keys[SDL_SCANCODE_RIGHT] ? 1.0f : 0.0f) - (keys[SDL_SCANCODE_LEFT] ? 1.0f : 0.0f);
+	float panY = (keys[SDL_SCANCODE_DOWN] ? 1.0f : 0.0f) - (keys[SDL_SCANCODE_UP] ? 1.0f : 0.0f);
+	float scale = (float)(1 << gLevel);
+	gCenterX += panX * PAN_SPEED * seconds * scale;
+	gCenterY += panY * PAN_SPEED * seconds * scale;
+	if (gCenterX < 0) gCenterX = 0;
+	if (gCenterY < 0) gCenterY = 0;
+	if (gCenterX > gImage.width) gCenterX = gImage.width;
+	if (gCenterY > gImage.height) gCenterY = gImage.height;
+
+	// Draw what is resident and queue the rest.
+	gFrame++;
+	collectLoadedTiles();
+	SDL_FillRect(gScreenSurface, NULL, SDL_MapRGB(gScreenSurface->format, 0x40, 0x40, 0x40));
+	renderViewport(panX, panY);
+	trimCache();
+
+	// Update the surface.
+	SDL_UpdateWindowSurface(gWindow);
+
+	// Report cache state once a second.
+	if (ticks - lastReport >= 1000) {
+	  char title[160];
+	  snprintf(title, sizeof(title), "Level %d: %d tiles, %d KB resident, %d hits, %d misses, %d evicted",
+		   gLevel, (int)gTileCache.size(), (int)(gCacheBytes / 1024), gCacheHits,
+		   gCacheMisses, gCacheEvictions);
+	  SDL_SetWindowTitle(gWindow, title);
+	  lastReport = ticks;
+	}
+      }
+
+      stopLoader();
+    }
+  }
+  // Free resources and quit SDL.
+  close();
+
+  return 0;
+}
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+bool init() {
+  // Initialization flag.
+  bool success = true;
+
+  // Initialize SDL.
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    std::cout << "SDL could not initialize! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    success = false;
+  }
+  else {
+    // Create window.
+    gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED,
+			      SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,
+			      SDL_WINDOW_SHOWN);
+    if (gWindow == NULL) {
+      std::cout << "Window could not be created! SDL_Error: " <<
+	SDL_GetError() << "\n";
+      success = false;
+    }
+    else {
+      // Initialize PNG loading.
+      int imgFlags = IMG_INIT_PNG;
+      if (!(IMG_Init(imgFlags) & imgFlags)) {
+	std::cout << "SDL_Image could not initialize! SDL_Image error: " <<
+	  IMG_GetError() << "\n";
+	success = false;
+      }
+      else {
+	// Get window surface.
+	gScreenSurface = SDL_GetWindowSurface(gWindow);
+      }
+    }
+  }
+  return success;
+}
+
+void close() {
+  // Deallocate surfaces.
+  for (std::map<TileKey, CachedTile>::iterator it = gTileCache.begin();
+       it != gTileCache.end(); ++it) {
+    SDL_FreeSurface(it->second.surface);
+  }
+  gTileCache.clear();
+  gLruList.clear();
+  gCacheBytes = 0;
+
+  // Destroy window.
+  SDL_DestroyWindow(gWindow);
+  gWindow = NULL;
+
+  // Quit SDL subsystems.
+  IMG_Quit();
+  SDL_Quit();
+}
+
+int levelWidth(int level) {
+  return (gImage.width + (1 << level) - 1) >> level;
+}
+
+int levelHeight(int level) {
+  return (gImage.height + (1 << level) - 1) >> level;
+}
+
+std::string tilePath(const std::string &directory, const TileKey &key) {
+  std::ostringstream path;
+  path << directory << "/tile_" << key.level << "_" << key.row << "_" << key.col << ".bmp";
+  return path.str();
+}
+
+// Reads little-endian integers from a BMP header.
+static Uint32 readLE32(const Uint8 *bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((Uint32)bytes[3] << 24);
+}
+
+static Uint16 readLE16(const Uint8 *bytes) {
+  return bytes[0] | (bytes[1] << 8);
+}
+
+// Source of full resolution rows for level 0. Uncompressed BMPs are read a
+// band at a time so that preprocessing memory does not grow with the image;
+// any other format is decoded whole.
+struct RowSource {
+  SDL_RWops *file;
+  SDL_Surface *whole;
+  int width;
+  int height;
+  Uint32 format;
+  Sint64 pixelOffset;
+  int stride;
+  bool bottomUp;
+};
+
+static bool openRowSource(const std::string &path, RowSource &source) {
+  source.file = NULL;
+  source.whole = NULL;
+
+  SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+  if (file == NULL) {
+    std::cout << "Unable to open image: " << path << "! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    return false;
+  }
+
+  Uint8 header[54];
+  if (SDL_RWread(file, header, sizeof(header), 1) == 1 && header[0] == 'B' && header[1] == 'M') {
+    int width = (Sint32)readLE32(header + 18);
+    int height = (Sint32)readLE32(header + 22);
+    int bpp = readLE16(header + 28);
+    Uint32 compression = readLE32(header + 30);
+    // Only plain 24 and 32 bit rows can be addressed directly.
+    if (compression == 0 && (bpp == 24 || bpp == 32) && width > 0) {
+      source.file = file;
+      source.width = width;
+      source.height = height < 0 ? -height : height;
+      source.bottomUp = height > 0;
+      source.format = bpp == 24 ? SDL_PIXELFORMAT_BGR24 : SDL_PIXELFORMAT_BGRA32;
+      source.pixelOffset = readLE32(header + 10);
+      source.stride = ((width * bpp + 31) / 32) * 4;
+      return true;
+    }
+  }
+  SDL_RWclose(file);
+
+  // Fall back to decoding the whole image.
+  source.whole = IMG_Load(path.c_str());
+  if (source.whole == NULL) {
+    std::cout << "Unable to load image: " << path << "! SDL_image Error: " <<
+      IMG_GetError() << "\n";
+    return false;
+  }
+  source.width = source.whole->w;
+  source.height = source.whole->h;
+  return true;
+}
+
+// Returns a surface holding rows [y, y + rows) of the source.
+static SDL_Surface* readRowBand(RowSource &source, int y, int rows) {
+  SDL_Rect bandRect = { 0, y, source.width, rows };
+  if (source.whole != NULL) {
+    SDL_Surface *band = SDL_CreateRGBSurfaceWithFormat(0, source.width, rows, 32,
+						       SDL_PIXELFORMAT_ARGB8888);
+    if (band != NULL) {
+      SDL_SetSurfaceBlendMode(source.whole, SDL_BLENDMODE_NONE);
+      SDL_BlitSurface(source.whole, &bandRect, band, NULL);
+    }
+    return band;
+  }
+
+  SDL_Surface *band = SDL_CreateRGBSurfaceWithFormat(0, source.width, rows,
+						     SDL_BYTESPERPIXEL(source.format) * 8,
+						     source.format);
+  if (band == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < rows; i++) {
+    int fileRow = source.bottomUp ? source.height - 1 - (y + i) : y + i;
+    Uint8 *dst = (Uint8*)band->pixels + i * band->pitch;
+    SDL_RWseek(source.file, source.pixelOffset + (Sint64)fileRow * source.stride, RW_SEEK_SET);
+    if (SDL_RWread(source.file, dst, source.width * SDL_BYTESPERPIXEL(source.format), 1) != 1) {
+      std::cout << "Unable to read image row " << y + i << "!\n";
+      SDL_FreeSurface(band);
+      return NULL;
+    }
+  }
+  // Copy the alpha channel of 32 bit sources rather than blending it.
+  SDL_SetSurfaceBlendMode(band, SDL_BLENDMODE_NONE);
+  return band;
+}
+
+static void closeRowSource(RowSource &source) {
+  if (source.file != NULL) {
+    SDL_RWclose(source.file);
+    source.file = NULL;
+  }
+  SDL_FreeSurface(source.whole);
+  source.whole = NULL;
+}
+
+bool buildTiles(std::string sourcePath, std::string directory) {
+  RowSource source;
+  if (!openRowSource(sourcePath, source)) {
+    return false;
+  }
+
+  gImage.directory = directory;
+  gImage.width = source.width;
+  gImage.height = source.height;
+  gImage.tileSize = TILE_SIZE;
+  gImage.levels = 1;
+  while (levelWidth(gImage.levels - 1) > TILE_SIZE || levelHeight(gImage.levels - 1) > TILE_SIZE) {
+    gImage.levels++;
+  }
+
+  // Level 0: cut one band of tile rows at a time from the source.
+  bool success = true;
+  int rows = (source.height + TILE_SIZE - 1) / TILE_SIZE;
+  int cols = (source.width + TILE_SIZE - 1) / TILE_SIZE;
+  for (int row = 0; row < rows && success; row++) {
+    int bandHeight = std::min(TILE_SIZE, source.height - row * TILE_SIZE);
+    SDL_Surface *band = readRowBand(source, row * TILE_SIZE, bandHeight);
+    if (band == NULL) {
+      success = false;
+      break;
+    }
+    for (int col = 0; col < cols; col++) {
+      SDL_Rect cell = { col * TILE_SIZE, 0, std::min(TILE_SIZE, source.width - col * TILE_SIZE),
+			bandHeight };
+      SDL_Surface *tile = SDL_CreateRGBSurfaceWithFormat(0, cell.w, cell.h, 24,
+							 SDL_PIXELFORMAT_BGR24);
+      TileKey key = { 0, row, col };
+      if (tile == NULL || SDL_BlitSurface(band, &cell, tile, NULL) < 0 ||
+	  SDL_SaveBMP(tile, tilePath(directory, key).c_str()) < 0) {
+	std::cout << "Unable to write tile: " << tilePath(directory, key) << "! SDL_Error: " <<
+	  SDL_GetError() << "\n";
+	success = false;
+      }
+      SDL_FreeSurface(tile);
+    }
+    SDL_FreeSurface(band);
+  }
+  closeRowSource(source);
+
+  // Each coarser level downsamples 2x2 tiles of the level below, so only
+  // five tiles are ever held at once.
+  for (int level = 1; level < gImage.levels && success; level++) {
+    int levelRows = (levelHeight(level) + TILE_SIZE - 1) / TILE_SIZE;
+    int levelCols = (levelWidth(level) + TILE_SIZE - 1) / TILE_SIZE;
+    for (int row = 0; row < levelRows && success; row++) {
+      for (int col = 0; col < levelCols && success; col++) {
+	int tileWidth = std::min(TILE_SIZE, levelWidth(level) - col * TILE_SIZE);
+	int tileHeight = std::min(TILE_SIZE, levelHeight(level) - row * TILE_SIZE);
+	SDL_Surface *tile = SDL_CreateRGBSurfaceWithFormat(0, tileWidth, tileHeight, 24,
+							   SDL_PIXELFORMAT_BGR24);
+	if (tile == NULL) {
+	  success = false;
+	  break;
+	}
+	for (int child = 0; child < 4; child++) {
+	  TileKey childKey = { level - 1, row * 2 + child / 2, col * 2 + child % 2 };
+	  SDL_Surface *childTile = SDL_LoadBMP(tilePath(directory, childKey).c_str());
+	  if (childTile == NULL) {
+	    // Children past the right or bottom edge do not exist.
+	    continue;
+	  }
+	  SDL_Rect quadrant = { (child % 2) * TILE_SIZE / 2, (child / 2) * TILE_SIZE / 2,
+				(childTile->w + 1) / 2, (childTile->h + 1) / 2 };
+	  SDL_BlitScaled(childTile, NULL, tile, &quadrant);
+	  SDL_FreeSurface(childTile);
+	}
+	TileKey key = { level, row, col };
+	if (SDL_SaveBMP(tile, tilePath(directory, key).c_str()) < 0) {
+	  std::cout << "Unable to write tile: " << tilePath(directory, key) << "! SDL_Error: " <<
+	    SDL_GetError() << "\n";
+	  success = false;
+	}
+	SDL_FreeSurface(tile);
+      }
+    }
+  }
+
+  // Write the description last so a partial build is never picked up.
+  if (success) {
+    std::ofstream manifest((directory + "/tiles.txt").c_str());
+    manifest << gImage.width << " " << gImage.height << " " << gImage.tileSize << " " <<
+      gImage.levels << "\n";
+    success = manifest.good();
+  }
+  if (success) {
+    std::cout << "Built " << gImage.levels << " levels of " << TILE_SIZE << "px tiles in " <<
+      directory << "\n";
+  }
+  return success;
+}
+
+bool loadTiledImage(std::string directory) {
+  std::ifstream manifest((directory + "/tiles.txt").c_str());
+  TiledImage image;
+  image.directory = directory;
+  if (!(manifest >> image.width >> image.height >> image.tileSize >> image.levels) ||
+      image.tileSize != TILE_SIZE || image.levels < 1) {
+    return false;
+  }
+  gImage = image;
+  gLevel = 0;
+  return true;
+}
+
+static int loaderThread(void *data) {
+  SDL_LockMutex(gLoaderMutex);
+  while (!gLoaderQuit) {
+    if (gPendingTiles.empty()) {
+      SDL_CondWait(gLoaderCond, gLoaderMutex);
+      continue;
+    }
+    TileKey key = gPendingTiles.front();
+    gPendingTiles.pop_front();
+    std::string path = tilePath(gImage.directory, key);
+    SDL_UnlockMutex(gLoaderMutex);
+
+    // Decode and convert to the screen format off the main thread.
+    SDL_Surface *optimizedSurface = NULL;
+    SDL_Surface *loadedSurface = SDL_LoadBMP(path.c_str());
+    if (loadedSurface == NULL) {
+      std::cout << "Unable to load tile: " << path << "! SDL_Error: " << SDL_GetError() << "\n";
+    }
+    else {
+      optimizedSurface = SDL_ConvertSurface(loadedSurface, gScreenSurface->format, 0);
+      SDL_FreeSurface(loadedSurface);
+    }
+
+    SDL_LockMutex(gLoaderMutex);
+    gLoadedTiles.push_back(std::make_pair(key, optimizedSurface));
+  }
+  SDL_UnlockMutex(gLoaderMutex);
+  return 0;
+}
+
+bool startLoader() {
+  gLoaderQuit = false;
+  gLoaderMutex = SDL_CreateMutex();
+  gLoaderCond = SDL_CreateCond();
+  if (gLoaderMutex == NULL || gLoaderCond == NULL) {
+    return false;
+  }
+  gLoaderThread = SDL_CreateThread(loaderThread, "TileLoader", NULL);
+  return gLoaderThread != NULL;
+}
+
+void stopLoader() {
+  SDL_LockMutex(gLoaderMutex);
+  gLoaderQuit = true;
+  SDL_CondSignal(gLoaderCond);
+  SDL_UnlockMutex(gLoaderMutex);
+  SDL_WaitThread(gLoaderThread, NULL);
+  gLoaderThread = NULL;
+
+  // Free anything the loader finished after the last frame.
+  for (size_t i = 0; i < gLoadedTiles.size(); i++) {
+    SDL_FreeSurface(gLoadedTiles[i].second);
+  }
+  gLoadedTiles.clear();
+  gPendingTiles.clear();
+  gInFlightTiles.clear();
+  SDL_DestroyCond(gLoaderCond);
+  SDL_DestroyMutex(gLoaderMutex);
+  gLoaderCond = NULL;
+  gLoaderMutex = NULL;
+}
+
+void requestTiles(const std::vector<TileKey> &keys) {
+  SDL_LockMutex(gLoaderMutex);
+  // Drop requests that were not started; they may have scrolled away.
+  for (size_t i = 0; i < gPendingTiles.size(); i++) {
+    gInFlightTiles.erase(gPendingTiles[i]);
+  }
+  gPendingTiles.clear();
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (gTileCache.count(keys[i]) == 0 && gInFlightTiles.insert(keys[i]).second) {
+      gPendingTiles.push_back(keys[i]);
+    }
+  }
+  if (!gPendingTiles.empty()) {
+    SDL_CondSignal(gLoaderCond);
+  }
+  SDL_UnlockMutex(gLoaderMutex);
+}
+
+void collectLoadedTiles() {
+  std::vector<std::pair<TileKey, SDL_Surface*> > loaded;
+  SDL_LockMutex(gLoaderMutex);
+  loaded.swap(gLoadedTiles);
+  for (size_t i = 0; i < loaded.size(); i++) {
+    gInFlightTiles.erase(loaded[i].first);
+  }
+  SDL_UnlockMutex(gLoaderMutex);
+
+  for (size_t i = 0; i < loaded.size(); i++) {
+    if (loaded[i].second == NULL) {
+      continue;
+    }
+    CachedTile tile;
+    tile.surface = loaded[i].second;
+    tile.lastUsedFrame = 0;
+    gLruList.push_front(loaded[i].first);
+    tile.lruPosition = gLruList.begin();
+    gTileCache[loaded[i].first] = tile;
+    gCacheBytes += (size_t)tile.surface->pitch * tile.surface->h;
+  }
+}
+
+SDL_Surface* findTile(const TileKey &key) {
+  std::map<TileKey, CachedTile>::iterator it = gTileCache.find(key);
+  if (it == gTileCache.end()) {
+    return NULL;
+  }
+  // Move to the front of the use order.
+  gLruList.splice(gLruList.begin(), gLruList, it->second.lruPosition);
+  it->second.lastUsedFrame = gFrame;
+  return it->second.surface;
+}
+
+void trimCache() {
+  std::list<TileKey>::iterator it = gLruList.end();
+  while (gCacheBytes > CACHE_BUDGET_BYTES && it != gLruList.begin()) {
+    --it;
+    CachedTile &tile = gTileCache[*it];
+    // Tiles on screen stay resident even if the budget is too small.
+    if (tile.lastUsedFrame == gFrame) {
+      continue;
+    }
+    gCacheBytes -= (size_t)tile.surface->pitch * tile.surface->h;
+    SDL_FreeSurface(tile.surface);
+    gTileCache.erase(*it);
+    it = gLruList.erase(it);
+    gCacheEvictions++;
+  }
+}
+
+// Draws a missing tile from the nearest resident coarser level.
+static void drawFallback(const TileKey &key, SDL_Rect dst) {
+  for (int up = 1; key.level + up < gImage.levels; up++) {
+    int cellSize = TILE_SIZE >> up;
+    if (cellSize == 0) {
+      break;
+    }
+    TileKey parentKey = { key.level + up, key.row >> up, key.col >> up };
+    SDL_Surface *parent = findTile(parentKey);
+    if (parent == NULL) {
+      continue;
+    }
+    int mask = (1 << up) - 1;
+    SDL_Rect src = { (key.col & mask) * cellSize, (key.row & mask) * cellSize,
+		     (dst.w + (1 << up) - 1) >> up, (dst.h + (1 << up) - 1) >> up };
+    if (src.x + src.w > parent->w) src.w = parent->w - src.x;
+    if (src.y + src.h > parent->h) src.h = parent->h - src.y;
+    if (src.w > 0 && src.h > 0) {
+      SDL_BlitScaled(parent, &src, gScreenSurface, &dst);
+    }
+    return;
+  }
+}
+
+void renderViewport(float panX, float panY) {
+  int scale = 1 << gLevel;
+  int width = levelWidth(gLevel);
+  int height = levelHeight(gLevel);
+  int originX = (int)(gCenterX / scale) - SCREEN_WIDTH / 2;
+  int originY = (int)(gCenterY / scale) - SCREEN_HEIGHT / 2;
+
+  // Visible tile range, clamped to the image.
+  int lastCol = (width - 1) / TILE_SIZE;
+  int lastRow = (height - 1) / TILE_SIZE;
+  int col0 = std::max(0, originX / TILE_SIZE);
+  int row0 = std::max(0, originY / TILE_SIZE);
+  int col1 = std::min(lastCol, (originX + SCREEN_WIDTH - 1) / TILE_SIZE);
+  int row1 = std::min(lastRow, (originY + SCREEN_HEIGHT - 1) / TILE_SIZE);
+
+  std::vector<TileKey> wanted;
+  for (int row = row0; row <= row1; row++) {
+    for (int col = col0; col <= col1; col++) {
+      TileKey key = { gLevel, row, col };
+      SDL_Rect dst = { col * TILE_SIZE - originX, row * TILE_SIZE - originY,
+		       std::min(TILE_SIZE, width - col * TILE_SIZE),
+		       std::min(TILE_SIZE, height - row * TILE_SIZE) };
+      SDL_Surface *tile = findTile(key);
+      if (tile != NULL) {
+	gCacheHits++;
+	SDL_BlitSurface(tile, NULL, gScreenSurface, &dst);
+      }
+      else {
+	gCacheMisses++;
+	wanted.push_back(key);
+	drawFallback(key, dst);
+      }
+    }
+  }
+
+  // The coarsest level is small and makes every fallback possible.
+  TileKey top = { gImage.levels - 1, 0, 0 };
+  if (gTileCache.count(top) == 0) {
+    wanted.insert(wanted.begin(), top);
+  }
+
+  // Prefetch ahead of the pan direction, nearest first.
+  int stepX = panX > 0 ? 1 : (panX < 0 ? -1 : 0);
+  int stepY = panY > 0 ? 1 : (panY < 0 ? -1 : 0);
+  for (int ahead = 1; ahead <= PREFETCH_TILES && (stepX != 0 || stepY != 0); ahead++) {
+    int pr0 = stepY > 0 ? row1 + ahead : (stepY < 0 ? row0 - ahead : row0);
+    int pr1 = stepY > 0 ? row1 + ahead : (stepY < 0 ? row0 - ahead : row1);
+    int pc0 = stepX > 0 ? col1 + ahead : (stepX < 0 ? col0 - ahead : col0);
+    int pc1 = stepX > 0 ? col1 + ahead : (stepX < 0 ? col0 - ahead : col1);
+    // Rows or columns entering from the side being panned towards.
+    for (int row = std::max(0, std::min(pr0, row0)); row <= std::min(lastRow, std::max(pr1, row1)); row++) {
+      for (int col = std::max(0, std::min(pc0, col0)); col <= std::min(lastCol, std::max(pc1, col1)); col++) {
+	bool inView = row >= row0 && row <= row1 && col >= col0 && col <= col1;
+	bool leading = (stepY != 0 && row >= pr0 && row <= pr1) ||
+	  (stepX != 0 && col >= pc0 && col <= pc1);
+	if (!inView && leading) {
+	  TileKey key = { gLevel, row, col };
+	  wanted.push_back(key);
+	}
+      }
+    }
+  }
+
+  requestTiles(wanted);
+}
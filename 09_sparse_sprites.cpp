@@ -0,0 +1,465 @@
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#else
+#include <SDL.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// One horizontal span of opaque pixels.
+struct RleRun {
+  // Column of the first pixel.
+  Uint16 x;
+  // Number of pixels.
+  Uint16 length;
+  // Index of the first pixel in RleSprite::pixels.
+  Uint32 offset;
+};
+
+// A sprite stored as runs of opaque pixels; the background is not stored.
+struct RleSprite {
+  int w;
+  int h;
+  // Runs of row y are runs[rowStart[y]] up to runs[rowStart[y + 1]].
+  std::vector<Uint32> rowStart;
+  std::vector<RleRun> runs;
+  std::vector<Uint32> pixels;
+};
+
+// How a sprite is stored and blitted.
+enum SpriteEncoding {
+		     SPRITE_ENCODING_DENSE,
+		     SPRITE_ENCODING_COLOR_KEY,
+		     SPRITE_ENCODING_RLE,
+		     SPRITE_ENCODING_TOTAL,
+};
+
+// A loaded sprite in every encoding, for comparison.
+struct SparseSprite {
+  std::string path;
+  // Dense copy in the screen format.
+  SDL_Surface *dense;
+  // Same pixels with a colour key and SDL_RLEACCEL, or NULL if not sparse.
+  SDL_Surface *colorKeyed;
+  // Our own run-length encoding, empty if not sparse.
+  RleSprite rle;
+  // Background colour and the fraction of pixels that match it.
+  Uint32 background;
+  double backgroundRatio;
+};
+
+// Starts up SDL and creates window.
+bool init();
+// Loads media.
+bool loadMedia();
+// Frees Media and shuts down SDL.
+void close();
+// Loads individual image.
+SDL_Surface* loadSurface(std::string path);
+
+// Loads an image and, if it is mostly one flat colour, prepares its colour
+// keyed and run-length encoded forms.
+bool loadSparseSprite(std::string path, SparseSprite &sprite);
+// Finds the most common border colour and how much of the image it covers.
+double findBackground(SDL_Surface *surface, Uint32 &background);
+// Encodes every pixel that is not background into runs.
+void encodeRle(SDL_Surface *surface, Uint32 background, RleSprite &rle);
+// Bytes held by an encoded sprite.
+size_t rleBytes(const RleSprite &rle);
+// Estimated size of SDL's own RLE data for the same runs.
+size_t sdlRleBytes(const RleSprite &rle, int bytesPerPixel);
+// Copies the runs of rle to target at (x, y), clipped to the target.
+void blitRle(const RleSprite &rle, SDL_Surface *target, int x, int y);
+// Draws sprite with the given encoding.
+void drawSprite(SparseSprite &sprite, SpriteEncoding encoding, int x, int y);
+// Prints stored bytes and blit cost of each encoding.
+void runBenchmark();
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// Window size.
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+
+// Images count as sparse when at least this much of them is background.
+const double SPARSE_THRESHOLD = 0.5;
+// Blits timed per sprite and encoding.
+const int BENCHMARK_BLITS = 200;
+
+// Images to compare.
+const char *SPRITE_PATHS[] = {
+  "04_key_presses/press.bmp",
+  "04_key_presses/up.bmp",
+  "04_key_presses/down.bmp",
+  "04_key_presses/left.bmp",
+  "04_key_presses/right.bmp",
+  "03_event_driven_programming/x.bmp",
+};
+const int SPRITE_TOTAL = sizeof(SPRITE_PATHS) / sizeof(SPRITE_PATHS[0]);
+const char *ENCODING_NAMES[SPRITE_ENCODING_TOTAL] = { "dense", "colour key", "rle" };
+
+// The window we will render to.
+SDL_Window *gWindow = NULL;
+// The surface contained by the window.
+SDL_Surface *gScreenSurface = NULL;
+// The sprites being compared.
+SparseSprite gSprites[SPRITE_TOTAL];
+
+// --------------------
+// -------------------- Main --------------------
+// --------------------
+
+int main(int argc, char **argv) {
+  // Start up SDL and create window.
+  if (!init()) {
+    std::cout << "Failed to initialize!\n";
+  }
+  else {
+    if (!loadMedia()) {
+      std::cout << "Failed to load media!\n";
+    }
+    else {
+      runBenchmark();
+
+      // Main loop flag.
+      bool quit = false;
+      // Event handler.
+      SDL_Event e;
+      // Shown sprite and encoding, cycled with the arrow keys and space.
+      int current = 0;
+      int encoding = SPRITE_ENCODING_RLE;
+
+      // While application is running.
+      while (!quit) {
+	// Handle events on queue.
+	while (SDL_PollEvent(&e) != 0) {
+	  // User requests quit.
+	  if (e.type == SDL_QUIT) {
+	    quit = true;
+	  }
+	  else if (e.type == SDL_KEYDOWN) {
+	    switch(e.key.keysym.sym) {
+	    case SDLK_SPACE:
+	      encoding = (encoding + 1) % SPRITE_ENCODING_TOTAL;
+	      break;
+	    case SDLK_RIGHT:
+	      current = (current + 1) % SPRITE_TOTAL;
+	      break;
+	    case SDLK_LEFT:
+	      current = (current + SPRITE_TOTAL - 1) % SPRITE_TOTAL;
+	      break;
+	    default:
+	      break;
+	    }
+	  }
+	}
+	// Draw over a checkerboard so that skipped pixels are visible.
+	for (int y = 0; y < SCREEN_HEIGHT; y += 32) {
+	  for (int x = 0; x < SCREEN_WIDTH; x += 32) {
+	    SDL_Rect cell = { x, y, 32, 32 };
+	    Uint8 shade = ((x + y) / 32) % 2 ? 0x60 : 0x90;
+	    SDL_FillRect(gScreenSurface, &cell, SDL_MapRGB(gScreenSurface->format, shade, shade, shade));
+	  }
+	}
+	drawSprite(gSprites[current], (SpriteEncoding)encoding, 0, 0);
+
+	char title[256];
+	snprintf(title, sizeof(title), "%s: %s", gSprites[current].path.c_str(),
+		 ENCODING_NAMES[encoding]);
+	SDL_SetWindowTitle(gWindow, title);
+
+	// Update the surface.
+	SDL_UpdateWindowSurface(gWindow);
+      }
+
+    }
+  }
+  // Free resources and quit SDL.
+  close();
+
+  return 0;
+}
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+bool init() {
+  // Initialization flag.
+  bool success = true;
+
+  // Initialize SDL.
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    std::cout << "SDL could not initialize! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    success = false;
+  }
+  else {
+    // Create window.
+    gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED,
+			      SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,
+			      SDL_WINDOW_SHOWN);
+    if (gWindow == NULL) {
+      std::cout << "Window could not be created! SDL_Error: " <<
+	SDL_GetError() << "\n";
+      success = false;
+    }
+    else {
+      // Get window surface.
+      gScreenSurface = SDL_GetWindowSurface(gWindow);
+    }
+  }
+  return success;
+}
+
+SDL_Surface* loadSurface(std::string path) {
+  SDL_Surface* optimizedSurface = NULL;
+
+  // Load image at specified path.
+  SDL_Surface* loadedSurface = SDL_LoadBMP(path.c_str());
+  if (loadedSurface == NULL) {
+    std::cout << "Unable to load image: " << path << "! SDL_Error: " <<
+      SDL_GetError() << "\n";
+  }
+  else {
+    // Convert surface to screen format.
+    optimizedSurface = SDL_ConvertSurface(loadedSurface, gScreenSurface->format, 0);
+    if (optimizedSurface == NULL) {
+      std::cout << "Unable to optimize image: " << path << "! SDL_Error: " <<
+	SDL_GetError() << "\n";
+    }
+    SDL_FreeSurface(loadedSurface);
+  }
+  return optimizedSurface;
+}
+
+bool loadMedia() {
+  // Loading success flag.
+  bool success = true;
+
+  for (int i = 0; i < SPRITE_TOTAL; i++) {
+    if (!loadSparseSprite(SPRITE_PATHS[i], gSprites[i])) {
+      std::cout << "Failed to load sprite " << SPRITE_PATHS[i] << "!\n";
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+void close() {
+  // Deallocate surfaces.
+  for (int i = 0; i < SPRITE_TOTAL; i++) {
+    SDL_FreeSurface(gSprites[i].dense);
+    SDL_FreeSurface(gSprites[i].colorKeyed);
+    gSprites[i].dense = NULL;
+    gSprites[i].colorKeyed = NULL;
+  }
+
+  // Destroy window.
+  SDL_DestroyWindow(gWindow);
+  gWindow = NULL;
+
+  // Quit SDL.
+  SDL_Quit();
+}
+
+// Reads the pixel at (x, y) of a 32 bit surface.
+static Uint32 pixelAt(SDL_Surface *surface, int x, int y) {
+  return ((Uint32*)((Uint8*)surface->pixels + y * surface->pitch))[x];
+}
+
+double findBackground(SDL_Surface *surface, Uint32 &background) {
+  SDL_LockSurface(surface);
+
+  // Flat backgrounds reach the edges, so vote with the border pixels only.
+  std::map<Uint32, int> votes;
+  for (int x = 0; x < surface->w; x++) {
+    votes[pixelAt(surface, x, 0)]++;
+    votes[pixelAt(surface, x, surface->h - 1)]++;
+  }
+  for (int y = 0; y < surface->h; y++) {
+    votes[pixelAt(surface, 0, y)]++;
+    votes[pixelAt(surface, surface->w - 1, y)]++;
+  }
+  int best = 0;
+  for (std::map<Uint32, int>::iterator it = votes.begin(); it != votes.end(); ++it) {
+    if (it->second > best) {
+      best = it->second;
+      background = it->first;
+    }
+  }
+
+  size_t matching = 0;
+  for (int y = 0; y < surface->h; y++) {
+    for (int x = 0; x < surface->w; x++) {
+      matching += pixelAt(surface, x, y) == background;
+    }
+  }
+
+  SDL_UnlockSurface(surface);
+  return (double)matching / ((size_t)surface->w * surface->h);
+}
+
+void encodeRle(SDL_Surface *surface, Uint32 background, RleSprite &rle) {
+  rle.w = surface->w;
+  rle.h = surface->h;
+  rle.rowStart.clear();
+  rle.runs.clear();
+  rle.pixels.clear();
+
+  SDL_LockSurface(surface);
+  for (int y = 0; y < surface->h; y++) {
+    rle.rowStart.push_back(rle.runs.size());
+    int x = 0;
+    while (x < surface->w) {
+      // Skip background, then collect the following opaque span.
+      while (x < surface->w && pixelAt(surface, x, y) == background) x++;
+      int start = x;
+      while (x < surface->w && x - start < 0xFFFF && pixelAt(surface, x, y) != background) {
+	rle.pixels.push_back(pixelAt(surface, x, y));
+	x++;
+      }
+      if (x > start) {
+	RleRun run;
+	run.x = start;
+	run.length = x - start;
+	run.offset = rle.pixels.size() - run.length;
+	rle.runs.push_back(run);
+      }
+    }
+  }
+  rle.rowStart.push_back(rle.runs.size());
+  SDL_UnlockSurface(surface);
+}
+
+size_t rleBytes(const RleSprite &rle) {
+  return rle.rowStart.size() * sizeof(Uint32) + rle.runs.size() * sizeof(RleRun) +
+    rle.pixels.size() * sizeof(Uint32);
+}
+
+size_t sdlRleBytes(const RleSprite &rle, int bytesPerPixel) {
+  // SDL stores a pair of counts (transparent skip, opaque run) ahead of each
+  // run's pixels, with 16-bit counts for 3 and 4 byte pixels, and ends each
+  // row and the surface with a terminating pair. Its data is private, so
+  // this follows the layout rather than measuring it.
+  size_t pairBytes = bytesPerPixel > 2 ? 2 * sizeof(Uint16) : 2 * sizeof(Uint8);
+  return (rle.runs.size() + rle.h + 1) * pairBytes + rle.pixels.size() * bytesPerPixel;
+}
+
+bool loadSparseSprite(std::string path, SparseSprite &sprite) {
+  sprite.path = path;
+  sprite.dense = loadSurface(path);
+  sprite.colorKeyed = NULL;
+  sprite.backgroundRatio = 0;
+  sprite.background = 0;
+  if (sprite.dense == NULL) {
+    return false;
+  }
+  // The scanning and our own runs assume 32 bit pixels; stay dense otherwise.
+  if (sprite.dense->format->BytesPerPixel != 4) {
+    return true;
+  }
+
+  sprite.backgroundRatio = findBackground(sprite.dense, sprite.background);
+  if (sprite.backgroundRatio < SPARSE_THRESHOLD) {
+    return true;
+  }
+
+  // SDL's own colour key RLE.
+  sprite.colorKeyed = SDL_ConvertSurface(sprite.dense, sprite.dense->format, 0);
+  if (sprite.colorKeyed != NULL) {
+    SDL_SetColorKey(sprite.colorKeyed, SDL_TRUE, sprite.background);
+    SDL_SetSurfaceRLE(sprite.colorKeyed, 1);
+  }
+
+  // Our run-length encoding.
+  encodeRle(sprite.dense, sprite.background, sprite.rle);
+  return true;
+}
+
+void blitRle(const RleSprite &rle, SDL_Surface *target, int x, int y) {
+  SDL_Rect clip = target->clip_rect;
+  int y0 = std::max(0, clip.y - y);
+  int y1 = std::min(rle.h, clip.y + clip.h - y);
+  int clipLeft = clip.x - x;
+  int clipRight = clip.x + clip.w - x;
+
+  if (SDL_MUSTLOCK(target)) {
+    SDL_LockSurface(target);
+  }
+  for (int row = y0; row < y1; row++) {
+    Uint32 *dst = (Uint32*)((Uint8*)target->pixels + (y + row) * target->pitch) + x;
+    for (Uint32 r = rle.rowStart[row]; r < rle.rowStart[row + 1]; r++) {
+      const RleRun &run = rle.runs[r];
+      // Clip the run horizontally; transparent pixels are never touched.
+      int start = std::max<int>(run.x, clipLeft);
+      int end = std::min<int>(run.x + run.length, clipRight);
+      if (start < end) {
+	memcpy(dst + start, &rle.pixels[run.offset + (start - run.x)], (end - start) * sizeof(Uint32));
+      }
+    }
+  }
+  if (SDL_MUSTLOCK(target)) {
+    SDL_UnlockSurface(target);
+  }
+}
+
+void drawSprite(SparseSprite &sprite, SpriteEncoding encoding, int x, int y) {
+  SDL_Rect dst = { x, y, 0, 0 };
+  if (encoding == SPRITE_ENCODING_COLOR_KEY && sprite.colorKeyed != NULL) {
+    SDL_BlitSurface(sprite.colorKeyed, NULL, gScreenSurface, &dst);
+  }
+  else if (encoding == SPRITE_ENCODING_RLE && !sprite.rle.runs.empty() &&
+	   gScreenSurface->format->format == sprite.dense->format->format) {
+    blitRle(sprite.rle, gScreenSurface, x, y);
+  }
+  else {
+    // Images that are not sparse are always drawn dense.
+    SDL_BlitSurface(sprite.dense, NULL, gScreenSurface, &dst);
+  }
+}
+
+void runBenchmark() {
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+
+  printf("%-36s %6s %12s %10s %12s %10s %12s %10s\n", "image", "bg %", "dense B", "dense us",
+	 "key B*", "key us", "rle B", "rle us");
+  for (int i = 0; i < SPRITE_TOTAL; i++) {
+    SparseSprite &sprite = gSprites[i];
+    double micros[SPRITE_ENCODING_TOTAL];
+    for (int encoding = 0; encoding < SPRITE_ENCODING_TOTAL; encoding++) {
+      // SDL encodes a colour keyed surface on its first blit; keep that out
+      // of the timing.
+      drawSprite(sprite, (SpriteEncoding)encoding, 0, 0);
+      Uint64 start = SDL_GetPerformanceCounter();
+      for (int n = 0; n < BENCHMARK_BLITS; n++) {
+	drawSprite(sprite, (SpriteEncoding)encoding, 0, 0);
+      }
+      micros[encoding] = (SDL_GetPerformanceCounter() - start) * 1000000.0 / frequency /
+	BENCHMARK_BLITS;
+    }
+
+    size_t denseBytes = (size_t)sprite.dense->pitch * sprite.dense->h;
+    bool sparse = sprite.colorKeyed != NULL;
+    size_t keyBytes = sparse ? sdlRleBytes(sprite.rle, sprite.dense->format->BytesPerPixel) :
+      denseBytes;
+    printf("%-36s %6.1f %12lu %10.1f %12lu %10.1f %12lu %10.1f\n", sprite.path.c_str(),
+	   sprite.backgroundRatio * 100, (unsigned long)denseBytes, micros[SPRITE_ENCODING_DENSE],
+	   (unsigned long)keyBytes, micros[SPRITE_ENCODING_COLOR_KEY],
+	   (unsigned long)(sparse ? rleBytes(sprite.rle) : denseBytes), micros[SPRITE_ENCODING_RLE]);
+  }
+  printf("* estimated from our runs; SDL frees the dense pixels once it has encoded them\n");
+}
@@ -0,0 +1,473 @@
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#else
+#include <SDL.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// A window, its surface and the worker that composites into it.
+struct ManagedWindow {
+  SDL_Window *window;
+  Uint32 id;
+  bool open;
+
+  // Window surface; only ever acquired on the main thread.
+  SDL_Surface *surface;
+  bool surfaceValid;
+  // Surface headers over the shared asset pixels. Each window has its own
+  // so that blit maps are never shared between workers.
+  SDL_Surface *background;
+  SDL_Surface *sprite;
+  Uint32 viewFormat;
+
+  // Scene state, advanced by the main thread before each job.
+  SDL_Rect spriteRect;
+  SDL_Rect lastSpriteRect;
+  int dx;
+  int dy;
+  bool fullDamage;
+  // Rects changed by the last job.
+  std::vector<SDL_Rect> damage;
+
+  // Worker thread and its handshake with the main thread.
+  SDL_Thread *worker;
+  SDL_mutex *mutex;
+  SDL_cond *cond;
+  bool jobPending;
+  bool jobDone;
+  bool quit;
+};
+
+// Starts up SDL.
+bool init();
+// Loads media.
+bool loadMedia();
+// Frees Media and shuts down SDL.
+void close();
+// Loads individual image.
+SDL_Surface* loadSurface(std::string path);
+
+// Creates a window with its worker on the given display.
+bool openWindow(int display, int index);
+// Stops the worker and destroys the window.
+void closeWindow(ManagedWindow &managed);
+// Returns the asset converted to format, converting it once per format.
+SDL_Surface* sharedAsset(int asset, Uint32 format);
+// Reacquires the window surface and its asset views after a resize.
+bool acquireSurface(ManagedWindow &managed);
+// Moves the sprite and hands a composite job to the worker.
+void postFrame(ManagedWindow &managed);
+// Waits for the worker and presents the damaged rects.
+void presentFrame(ManagedWindow &managed);
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// Shared asset constants.
+enum SharedAssets {
+		   SHARED_ASSET_BACKGROUND,
+		   SHARED_ASSET_SPRITE,
+		   SHARED_ASSET_TOTAL,
+};
+
+// Window size.
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+// Size of the moving sprite.
+const int SPRITE_SIZE = 128;
+
+// Files the shared assets are loaded from.
+const char *SHARED_ASSET_PATHS[SHARED_ASSET_TOTAL] = {
+  "04_key_presses/press.bmp",
+  "03_event_driven_programming/x.bmp",
+};
+
+// Decoded assets, kept to convert for windows with a new pixel format.
+SDL_Surface *gAssetSources[SHARED_ASSET_TOTAL];
+// Converted assets by pixel format, shared by every window.
+std::map<Uint32, SDL_Surface*> gSharedAssets[SHARED_ASSET_TOTAL];
+// The windows being driven.
+std::vector<ManagedWindow*> gWindows;
+
+// --------------------
+// -------------------- Main --------------------
+// --------------------
+
+int main(int argc, char **argv) {
+  // Start up SDL.
+  if (!init()) {
+    std::cout << "Failed to initialize!\n";
+  }
+  else {
+    if (!loadMedia()) {
+      std::cout << "Failed to load media!\n";
+    }
+    else {
+      // One window per display unless a count is given.
+      int displays = SDL_GetNumVideoDisplays();
+      if (displays < 1) {
+	std::cout << "Unable to count displays! SDL_Error: " << SDL_GetError() << "\n";
+      }
+      int count = argc > 1 ? atoi(argv[1]) : displays;
+      for (int i = 0; i < count; i++) {
+	if (!openWindow(displays > 0 ? i % displays : 0, i)) {
+	  std::cout << "Failed to open window " << i << "!\n";
+	}
+      }
+
+      // Event handler.
+      SDL_Event e;
+      int openWindows = gWindows.size();
+
+      // While any window is open.
+      while (openWindows > 0) {
+	// Events are dispatched on the main thread only.
+	while (SDL_PollEvent(&e) != 0) {
+	  if (e.type == SDL_QUIT) {
+	    openWindows = 0;
+	  }
+	  else if (e.type == SDL_WINDOWEVENT) {
+	    for (size_t i = 0; i < gWindows.size(); i++) {
+	      ManagedWindow &managed = *gWindows[i];
+	      if (!managed.open || managed.id != e.window.windowID) {
+		continue;
+	      }
+	      if (e.window.event == SDL_WINDOWEVENT_CLOSE) {
+		closeWindow(managed);
+		openWindows--;
+	      }
+	      else if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED ||
+		       e.window.event == SDL_WINDOWEVENT_EXPOSED) {
+		managed.surfaceValid = false;
+	      }
+	    }
+	  }
+	}
+
+	// Let every worker composite at once, then present in turn.
+	for (size_t i = 0; i < gWindows.size() && openWindows > 0; i++) {
+	  if (gWindows[i]->open) {
+	    postFrame(*gWindows[i]);
+	  }
+	}
+	for (size_t i = 0; i < gWindows.size() && openWindows > 0; i++) {
+	  if (gWindows[i]->open) {
+	    presentFrame(*gWindows[i]);
+	  }
+	}
+      }
+
+    }
+  }
+  // Free resources and quit SDL.
+  close();
+
+  return 0;
+}
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+bool init() {
+  // Initialization flag.
+  bool success = true;
+
+  // Initialize SDL; windows are created once the assets are loaded.
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    std::cout << "SDL could not initialize! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    success = false;
+  }
+  return success;
+}
+
+SDL_Surface* loadSurface(std::string path) {
+  // Load image at specified path.
+  SDL_Surface* loadedSurface = SDL_LoadBMP(path.c_str());
+  if (loadedSurface == NULL) {
+    std::cout << "Unable to load image: " << path << "! SDL_Error: " <<
+      SDL_GetError() << "\n";
+  }
+  return loadedSurface;
+}
+
+bool loadMedia() {
+  // Loading success flag.
+  bool success = true;
+
+  // Decode each asset once for all windows.
+  for (int i = 0; i < SHARED_ASSET_TOTAL; i++) {
+    gAssetSources[i] = loadSurface(SHARED_ASSET_PATHS[i]);
+    if (gAssetSources[i] == NULL) {
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+void close() {
+  // Close any windows still open.
+  for (size_t i = 0; i < gWindows.size(); i++) {
+    if (gWindows[i]->open) {
+      closeWindow(*gWindows[i]);
+    }
+    delete gWindows[i];
+  }
+  gWindows.clear();
+
+  // Deallocate surfaces.
+  for (int i = 0; i < SHARED_ASSET_TOTAL; i++) {
+    for (std::map<Uint32, SDL_Surface*>::iterator it = gSharedAssets[i].begin();
+	 it != gSharedAssets[i].end(); ++it) {
+      SDL_FreeSurface(it->second);
+    }
+    gSharedAssets[i].clear();
+    SDL_FreeSurface(gAssetSources[i]);
+    gAssetSources[i] = NULL;
+  }
+
+  // Quit SDL.
+  SDL_Quit();
+}
+
+SDL_Surface* sharedAsset(int asset, Uint32 format) {
+  std::map<Uint32, SDL_Surface*>::iterator it = gSharedAssets[asset].find(format);
+  if (it != gSharedAssets[asset].end()) {
+    return it->second;
+  }
+  SDL_Surface *converted = SDL_ConvertSurfaceFormat(gAssetSources[asset], format, 0);
+  if (converted == NULL) {
+    std::cout << "Unable to optimize image: " << SHARED_ASSET_PATHS[asset] << "! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    return NULL;
+  }
+  gSharedAssets[asset][format] = converted;
+  return converted;
+}
+
+// Wraps the pixels of a shared surface in a new surface header.
+static SDL_Surface* createView(SDL_Surface *shared) {
+  if (shared == NULL) {
+    return NULL;
+  }
+  return SDL_CreateRGBSurfaceWithFormatFrom(shared->pixels, shared->w, shared->h,
+					    shared->format->BitsPerPixel, shared->pitch,
+					    shared->format->format);
+}
+
+// Fills rect of target by tiling background.
+static void drawBackground(SDL_Surface *background, SDL_Surface *target, SDL_Rect rect) {
+  SDL_SetClipRect(target, &rect);
+  for (int y = (rect.y / background->h) * background->h; y < rect.y + rect.h; y += background->h) {
+    for (int x = (rect.x / background->w) * background->w; x < rect.x + rect.w; x += background->w) {
+      SDL_Rect dst = { x, y, 0, 0 };
+      SDL_BlitSurface(background, NULL, target, &dst);
+    }
+  }
+  SDL_SetClipRect(target, NULL);
+}
+
+// Composites one frame of a window. Runs on the window's worker thread and
+// touches nothing but the window's own surfaces.
+static void composite(ManagedWindow &managed) {
+  SDL_Surface *surface = managed.surface;
+  SDL_Rect bounds = { 0, 0, surface->w, surface->h };
+  managed.damage.clear();
+
+  if (managed.fullDamage) {
+    drawBackground(managed.background, surface, bounds);
+    managed.damage.push_back(bounds);
+  }
+  else {
+    // Restore what the sprite covered last frame.
+    SDL_Rect old;
+    if (SDL_IntersectRect(&managed.lastSpriteRect, &bounds, &old)) {
+      drawBackground(managed.background, surface, old);
+      managed.damage.push_back(old);
+    }
+  }
+
+  SDL_Rect cell = { 0, 0, SPRITE_SIZE, SPRITE_SIZE };
+  SDL_Rect dst = managed.spriteRect;
+  SDL_BlitSurface(managed.sprite, &cell, surface, &dst);
+  SDL_Rect drawn;
+  if (!managed.fullDamage && SDL_IntersectRect(&managed.spriteRect, &bounds, &drawn)) {
+    managed.damage.push_back(drawn);
+  }
+}
+
+static int windowWorker(void *data) {
+  ManagedWindow &managed = *(ManagedWindow*)data;
+  SDL_LockMutex(managed.mutex);
+  while (true) {
+    while (!managed.jobPending && !managed.quit) {
+      SDL_CondWait(managed.cond, managed.mutex);
+    }
+    if (managed.quit) {
+      break;
+    }
+    managed.jobPending = false;
+    SDL_UnlockMutex(managed.mutex);
+
+    composite(managed);
+
+    SDL_LockMutex(managed.mutex);
+    managed.jobDone = true;
+    SDL_CondBroadcast(managed.cond);
+  }
+  SDL_UnlockMutex(managed.mutex);
+  return 0;
+}
+
+bool openWindow(int display, int index) {
+  ManagedWindow *managed = new ManagedWindow();
+  char title[64];
+  snprintf(title, sizeof(title), "SDL Tutorial - panel %d", index);
+
+  // Stagger windows sharing a display so they do not stack exactly.
+  SDL_Rect displayBounds = { 0, 0, 0, 0 };
+  SDL_GetDisplayBounds(display, &displayBounds);
+  int offset = 32 * (index / std::max(1, SDL_GetNumVideoDisplays()));
+  managed->window = SDL_CreateWindow(title, displayBounds.x + offset, displayBounds.y + offset,
+				     SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+  if (managed->window == NULL) {
+    std::cout << "Window could not be created! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    delete managed;
+    return false;
+  }
+  managed->id = SDL_GetWindowID(managed->window);
+  managed->open = true;
+  managed->surfaceValid = false;
+  managed->spriteRect.x = (index * 97) % (SCREEN_WIDTH - SPRITE_SIZE);
+  managed->spriteRect.y = (index * 61) % (SCREEN_HEIGHT - SPRITE_SIZE);
+  managed->spriteRect.w = SPRITE_SIZE;
+  managed->spriteRect.h = SPRITE_SIZE;
+  managed->lastSpriteRect = managed->spriteRect;
+  managed->dx = index % 2 ? -3 : 3;
+  managed->dy = 2;
+
+  managed->mutex = SDL_CreateMutex();
+  managed->cond = SDL_CreateCond();
+  managed->jobPending = false;
+  managed->jobDone = true;
+  managed->quit = false;
+  managed->worker = SDL_CreateThread(windowWorker, "WindowWorker", managed);
+  if (managed->worker == NULL) {
+    std::cout << "Worker could not be created! SDL_Error: " << SDL_GetError() << "\n";
+    SDL_DestroyWindow(managed->window);
+    SDL_DestroyCond(managed->cond);
+    SDL_DestroyMutex(managed->mutex);
+    delete managed;
+    return false;
+  }
+  gWindows.push_back(managed);
+  return true;
+}
+
+void closeWindow(ManagedWindow &managed) {
+  SDL_LockMutex(managed.mutex);
+  managed.quit = true;
+  SDL_CondBroadcast(managed.cond);
+  SDL_UnlockMutex(managed.mutex);
+  SDL_WaitThread(managed.worker, NULL);
+  managed.worker = NULL;
+
+  SDL_DestroyCond(managed.cond);
+  SDL_DestroyMutex(managed.mutex);
+  SDL_FreeSurface(managed.background);
+  SDL_FreeSurface(managed.sprite);
+  managed.background = NULL;
+  managed.sprite = NULL;
+
+  // The window owns its surface.
+  SDL_DestroyWindow(managed.window);
+  managed.window = NULL;
+  managed.surface = NULL;
+  managed.open = false;
+}
+
+// Keeps the sprite inside the window, or at its top left corner if the
+// window is smaller than the sprite.
+static void clampSprite(ManagedWindow &managed) {
+  managed.spriteRect.x = std::max(0, std::min(managed.spriteRect.x, managed.surface->w - SPRITE_SIZE));
+  managed.spriteRect.y = std::max(0, std::min(managed.spriteRect.y, managed.surface->h - SPRITE_SIZE));
+}
+
+bool acquireSurface(ManagedWindow &managed) {
+  managed.surface = SDL_GetWindowSurface(managed.window);
+  if (managed.surface == NULL) {
+    return false;
+  }
+  // A resize may have left the sprite outside the new bounds.
+  clampSprite(managed);
+
+  // Views only need rebuilding when the pixel format changes.
+  Uint32 format = managed.surface->format->format;
+  if (managed.background == NULL || managed.viewFormat != format) {
+    SDL_FreeSurface(managed.background);
+    SDL_FreeSurface(managed.sprite);
+    managed.background = createView(sharedAsset(SHARED_ASSET_BACKGROUND, format));
+    managed.sprite = createView(sharedAsset(SHARED_ASSET_SPRITE, format));
+    managed.viewFormat = format;
+  }
+  managed.surfaceValid = managed.background != NULL && managed.sprite != NULL;
+  managed.fullDamage = true;
+  return managed.surfaceValid;
+}
+
+void postFrame(ManagedWindow &managed) {
+  // Window surfaces must be acquired on the main thread.
+  if (!managed.surfaceValid && !acquireSurface(managed)) {
+    managed.damage.clear();
+    return;
+  }
+
+  // Bounce the sprite off the window edges, turning only when it is moving
+  // outward so it cannot get stuck flipping back and forth.
+  managed.lastSpriteRect = managed.spriteRect;
+  managed.spriteRect.x += managed.dx;
+  managed.spriteRect.y += managed.dy;
+  if ((managed.spriteRect.x < 0 && managed.dx < 0) ||
+      (managed.spriteRect.x + SPRITE_SIZE > managed.surface->w && managed.dx > 0)) {
+    managed.dx = -managed.dx;
+  }
+  if ((managed.spriteRect.y < 0 && managed.dy < 0) ||
+      (managed.spriteRect.y + SPRITE_SIZE > managed.surface->h && managed.dy > 0)) {
+    managed.dy = -managed.dy;
+  }
+  clampSprite(managed);
+
+  SDL_LockMutex(managed.mutex);
+  managed.jobPending = true;
+  managed.jobDone = false;
+  SDL_CondBroadcast(managed.cond);
+  SDL_UnlockMutex(managed.mutex);
+}
+
+void presentFrame(ManagedWindow &managed) {
+  SDL_LockMutex(managed.mutex);
+  while (!managed.jobDone) {
+    SDL_CondWait(managed.cond, managed.mutex);
+  }
+  SDL_UnlockMutex(managed.mutex);
+
+  if (!managed.damage.empty()) {
+    SDL_UpdateWindowSurfaceRects(managed.window, &managed.damage[0], managed.damage.size());
+  }
+  managed.fullDamage = false;
+}
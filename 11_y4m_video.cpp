@@ -0,0 +1,768 @@
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#else
+#include <SDL.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// GCC and Clang need the AVX2 kernel marked so it can be built without -mavx2.
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// Stream parameters from the YUV4MPEG2 header.
+struct Y4MInfo {
+  int width;
+  int height;
+  int fpsNum;
+  int fpsDen;
+  // Offset of the first FRAME marker.
+  Sint64 dataOffset;
+  // Bytes of one planar 4:2:0 frame.
+  size_t frameBytes;
+};
+
+// One slot of the read-ahead ring.
+struct FrameSlot {
+  std::vector<Uint8> data;
+  // Index of the frame held, valid while full.
+  int index;
+  bool full;
+};
+
+// Playback counters.
+struct PlaybackStats {
+  int presented;
+  // Frames skipped because they were already late.
+  int dropped;
+  // Times the reader had not delivered the next frame in time.
+  int underruns;
+  double convertMs;
+};
+
+// Converts one row of 4:2:0 samples to 32 bit XRGB.
+typedef void (*ConvertRowFunction)(const Uint8 *y, const Uint8 *u, const Uint8 *v,
+				   Uint32 *dst, int width);
+
+// Starts up SDL and creates window.
+bool init();
+// Loads media.
+bool loadMedia(std::string path);
+// Frees Media and shuts down SDL.
+void close();
+
+// Parses the stream header of an open Y4M file.
+bool readY4MHeader(SDL_RWops *file, Y4MInfo &info);
+// Reads past a FRAME marker and any parameters after it.
+bool skipFrameMarker(SDL_RWops *file);
+// Starts and stops the read-ahead thread.
+bool startReader();
+void stopReader();
+// Returns the slot holding the next frame, or NULL if none is ready yet.
+FrameSlot* peekFrame();
+// Hands a slot back to the reader.
+void releaseFrame(FrameSlot *slot);
+
+// Scalar and SIMD row converters; all produce identical output.
+void convertRowScalar(const Uint8 *y, const Uint8 *u, const Uint8 *v, Uint32 *dst, int width);
+#ifdef HAVE_X86_KERNELS
+void convertRowSSE2(const Uint8 *y, const Uint8 *u, const Uint8 *v, Uint32 *dst, int width);
+TARGET_AVX2 void convertRowAVX2(const Uint8 *y, const Uint8 *u, const Uint8 *v, Uint32 *dst,
+				int width);
+#endif
+// Picks the fastest converter the CPU supports.
+ConvertRowFunction selectConverter(const char **name);
+// Converts a whole frame into a 32 bit XRGB surface.
+void convertFrame(ConvertRowFunction convertRow, const Uint8 *frame, SDL_Surface *target);
+
+// Plays the stream on a paced timeline.
+void play();
+// Times every converter on the stream and checks they agree.
+void runBenchmark();
+// Writes a synthetic clip for testing.
+bool generateClip(std::string path, int width, int height, int frames);
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// Window size.
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+
+// Frames read ahead of playback.
+const int READ_AHEAD_FRAMES = 8;
+// Frames converted per converter in the benchmark.
+const int BENCHMARK_FRAMES = 60;
+
+// The window we will render to.
+SDL_Window *gWindow = NULL;
+// The surface contained by the window.
+SDL_Surface *gScreenSurface = NULL;
+// Converted frame, used when the screen cannot take the frame directly.
+SDL_Surface *gFrameSurface = NULL;
+
+// The stream being played.
+std::string gVideoPath;
+Y4MInfo gVideo;
+
+// Read-ahead ring, guarded by gReaderMutex.
+FrameSlot gSlots[READ_AHEAD_FRAMES];
+SDL_Thread *gReaderThread = NULL;
+SDL_mutex *gReaderMutex = NULL;
+SDL_cond *gReaderCond = NULL;
+bool gReaderQuit = false;
+bool gReaderEnd = false;
+// Next slot the reader fills and the player takes.
+int gFillSlot = 0;
+int gTakeSlot = 0;
+
+// --------------------
+// -------------------- Main --------------------
+// --------------------
+
+int main(int argc, char **argv) {
+  // --generate <out.y4m> [width height frames] writes a test clip.
+  if (argc > 2 && std::string(argv[1]) == "--generate") {
+    int width = argc > 4 ? atoi(argv[3]) : 1920;
+    int height = argc > 4 ? atoi(argv[4]) : 1080;
+    int frames = argc > 5 ? atoi(argv[5]) : 300;
+    return generateClip(argv[2], width, height, frames) ? 0 : 1;
+  }
+
+  // <clip.y4m> plays, --bench <clip.y4m> times the converters.
+  bool benchmark = argc > 2 && std::string(argv[1]) == "--bench";
+  if (argc < 2 || (std::string(argv[1]) == "--bench" && argc < 3)) {
+    std::cout << "Usage: " << argv[0] << " [--bench] <clip.y4m>\n" <<
+      "       " << argv[0] << " --generate <clip.y4m> [width height frames]\n";
+    return 1;
+  }
+
+  // Start up SDL and create window.
+  if (!init()) {
+    std::cout << "Failed to initialize!\n";
+  }
+  else {
+    if (!loadMedia(argv[benchmark ? 2 : 1])) {
+      std::cout << "Failed to load media!\n";
+    }
+    else if (benchmark) {
+      runBenchmark();
+    }
+    else {
+      play();
+    }
+  }
+  // Free resources and quit SDL.
+  close();
+
+  return 0;
+}
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+bool init() {
+  // Initialization flag.
+  bool success = true;
+
+  // Initialize SDL.
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    std::cout << "SDL could not initialize! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    success = false;
+  }
+  else {
+    // Create window.
+    gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED,
+			      SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,
+			      SDL_WINDOW_SHOWN);
+    if (gWindow == NULL) {
+      std::cout << "Window could not be created! SDL_Error: " <<
+	SDL_GetError() << "\n";
+      success = false;
+    }
+    else {
+      // Get window surface.
+      gScreenSurface = SDL_GetWindowSurface(gWindow);
+    }
+  }
+  return success;
+}
+
+bool loadMedia(std::string path) {
+  // Loading success flag.
+  bool success = true;
+
+  SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+  if (file == NULL) {
+    std::cout << "Unable to open video: " << path << "! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    return false;
+  }
+  success = readY4MHeader(file, gVideo);
+  SDL_RWclose(file);
+  if (!success) {
+    std::cout << "Unsupported video: " << path << "!\n";
+    return false;
+  }
+  gVideoPath = path;
+
+  // Frames are converted straight to XRGB.
+  gFrameSurface = SDL_CreateRGBSurfaceWithFormat(0, gVideo.width, gVideo.height, 32,
+						 SDL_PIXELFORMAT_RGB888);
+  if (gFrameSurface == NULL) {
+    std::cout << "Unable to create frame surface! SDL_Error: " << SDL_GetError() << "\n";
+    success = false;
+  }
+
+  return success;
+}
+
+void close() {
+  // Deallocate surfaces.
+  SDL_FreeSurface(gFrameSurface);
+  gFrameSurface = NULL;
+
+  // Destroy window.
+  SDL_DestroyWindow(gWindow);
+  gWindow = NULL;
+
+  // Quit SDL.
+  SDL_Quit();
+}
+
+bool readY4MHeader(SDL_RWops *file, Y4MInfo &info) {
+  // The header is a single text line.
+  std::string line;
+  char c;
+  while (SDL_RWread(file, &c, 1, 1) == 1 && c != '\n' && line.size() < 1024) {
+    line += c;
+  }
+  if (line.compare(0, 10, "YUV4MPEG2 ") != 0) {
+    return false;
+  }
+
+  info.width = 0;
+  info.height = 0;
+  info.fpsNum = 30;
+  info.fpsDen = 1;
+  std::istringstream tokens(line.substr(10));
+  std::string token;
+  while (tokens >> token) {
+    switch (token[0]) {
+    case 'W':
+      info.width = atoi(token.c_str() + 1);
+      break;
+    case 'H':
+      info.height = atoi(token.c_str() + 1);
+      break;
+    case 'F':
+      sscanf(token.c_str() + 1, "%d:%d", &info.fpsNum, &info.fpsDen);
+      break;
+    case 'C':
+      // Only 8-bit 4:2:0 chroma is handled; every siting is treated alike.
+      // C420p10 and C420p12 use two bytes per sample and are rejected.
+      if (token != "C420" && token != "C420jpeg" && token != "C420paldv" &&
+	  token != "C420mpeg2") {
+	return false;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  if (info.width <= 0 || info.height <= 0 || info.fpsNum <= 0 || info.fpsDen <= 0) {
+    return false;
+  }
+  info.dataOffset = line.size() + 1;
+  size_t chromaBytes = (size_t)((info.width + 1) / 2) * ((info.height + 1) / 2);
+  info.frameBytes = (size_t)info.width * info.height + 2 * chromaBytes;
+  return true;
+}
+
+bool skipFrameMarker(SDL_RWops *file) {
+  char marker[5];
+  if (SDL_RWread(file, marker, sizeof(marker), 1) != 1 || memcmp(marker, "FRAME", 5) != 0) {
+    return false;
+  }
+  char c = 0;
+  while (c != '\n') {
+    if (SDL_RWread(file, &c, 1, 1) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reads frames into free ring slots until the end of the stream.
+static int readerThread(void *data) {
+  SDL_RWops *file = SDL_RWFromFile(gVideoPath.c_str(), "rb");
+  if (file != NULL) {
+    SDL_RWseek(file, gVideo.dataOffset, RW_SEEK_SET);
+  }
+
+  int index = 0;
+  while (file != NULL) {
+    SDL_LockMutex(gReaderMutex);
+    while (gSlots[gFillSlot].full && !gReaderQuit) {
+      SDL_CondWait(gReaderCond, gReaderMutex);
+    }
+    FrameSlot &slot = gSlots[gFillSlot];
+    bool quit = gReaderQuit;
+    SDL_UnlockMutex(gReaderMutex);
+    if (quit) {
+      break;
+    }
+
+    if (!skipFrameMarker(file) ||
+	SDL_RWread(file, &slot.data[0], gVideo.frameBytes, 1) != 1) {
+      break;
+    }
+
+    SDL_LockMutex(gReaderMutex);
+    slot.index = index++;
+    slot.full = true;
+    gFillSlot = (gFillSlot + 1) % READ_AHEAD_FRAMES;
+    SDL_CondBroadcast(gReaderCond);
+    SDL_UnlockMutex(gReaderMutex);
+  }
+
+  if (file != NULL) {
+    SDL_RWclose(file);
+  }
+  SDL_LockMutex(gReaderMutex);
+  gReaderEnd = true;
+  SDL_CondBroadcast(gReaderCond);
+  SDL_UnlockMutex(gReaderMutex);
+  return 0;
+}
+
+bool startReader() {
+  for (int i = 0; i < READ_AHEAD_FRAMES; i++) {
+    gSlots[i].data.resize(gVideo.frameBytes);
+    gSlots[i].full = false;
+  }
+  gFillSlot = 0;
+  gTakeSlot = 0;
+  gReaderQuit = false;
+  gReaderEnd = false;
+  gReaderMutex = SDL_CreateMutex();
+  gReaderCond = SDL_CreateCond();
+  if (gReaderMutex == NULL || gReaderCond == NULL) {
+    return false;
+  }
+  gReaderThread = SDL_CreateThread(readerThread, "VideoReader", NULL);
+  return gReaderThread != NULL;
+}
+
+void stopReader() {
+  SDL_LockMutex(gReaderMutex);
+  gReaderQuit = true;
+  SDL_CondBroadcast(gReaderCond);
+  SDL_UnlockMutex(gReaderMutex);
+  SDL_WaitThread(gReaderThread, NULL);
+  gReaderThread = NULL;
+  SDL_DestroyCond(gReaderCond);
+  SDL_DestroyMutex(gReaderMutex);
+  gReaderCond = NULL;
+  gReaderMutex = NULL;
+  for (int i = 0; i < READ_AHEAD_FRAMES; i++) {
+    std::vector<Uint8>().swap(gSlots[i].data);
+  }
+}
+
+FrameSlot* peekFrame() {
+  SDL_LockMutex(gReaderMutex);
+  FrameSlot *slot = gSlots[gTakeSlot].full ? &gSlots[gTakeSlot] : NULL;
+  SDL_UnlockMutex(gReaderMutex);
+  return slot;
+}
+
+void releaseFrame(FrameSlot *slot) {
+  SDL_LockMutex(gReaderMutex);
+  slot->full = false;
+  gTakeSlot = (gTakeSlot + 1) % READ_AHEAD_FRAMES;
+  SDL_CondBroadcast(gReaderCond);
+  SDL_UnlockMutex(gReaderMutex);
+}
+
+// BT.601 limited range in 6 bit fixed point. The luma factor is rounded up
+// from 74.5 so that Y=235 reaches full white. The SIMD kernels use the same
+// constants and 16 bit saturating arithmetic, so every path is bit exact.
+static inline Uint8 clampByte(int value) {
+  return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static inline int saturate16(int value) {
+  return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+}
+
+void convertRowScalar(const Uint8 *y, const Uint8 *u, const Uint8 *v, Uint32 *dst, int width) {
+  for (int x = 0; x < width; x++) {
+    int luma = (y[x] - 16) * 75;
+    int cb = u[x / 2] - 128;
+    int cr = v[x / 2] - 128;
+    int r = saturate16(saturate16(luma + 102 * cr) + 32) >> 6;
+    int g = saturate16(saturate16(saturate16(luma - 25 * cb) - 52 * cr) + 32) >> 6;
+    int b = saturate16(saturate16(luma + 129 * cb) + 32) >> 6;
+    dst[x] = 0xFF000000 | (clampByte(r) << 16) | (clampByte(g) << 8) | clampByte(b);
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+void convertRowSSE2(const Uint8 *y, const Uint8 *u, const Uint8 *v, Uint32 *dst, int width) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi8((char)0xFF);
+  const __m128i lumaOffset = _mm_set1_epi16(16);
+  const __m128i chromaOffset = _mm_set1_epi16(128);
+  const __m128i lumaScale = _mm_set1_epi16(75);
+  const __m128i crToR = _mm_set1_epi16(102);
+  const __m128i cbToG = _mm_set1_epi16(25);
+  const __m128i crToG = _mm_set1_epi16(52);
+  const __m128i cbToB = _mm_set1_epi16(129);
+  const __m128i round = _mm_set1_epi16(32);
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i y8 = _mm_loadu_si128((const __m128i*)(y + x));
+    // Each chroma sample covers two pixels.
+    __m128i u8 = _mm_loadl_epi64((const __m128i*)(u + x / 2));
+    __m128i v8 = _mm_loadl_epi64((const __m128i*)(v + x / 2));
+    u8 = _mm_unpacklo_epi8(u8, u8);
+    v8 = _mm_unpacklo_epi8(v8, v8);
+
+    __m128i rgb[3][2];
+    for (int half = 0; half < 2; half++) {
+      __m128i y16 = half ? _mm_unpackhi_epi8(y8, zero) : _mm_unpacklo_epi8(y8, zero);
+      __m128i cb = _mm_sub_epi16(half ? _mm_unpackhi_epi8(u8, zero) : _mm_unpacklo_epi8(u8, zero),
+				 chromaOffset);
+      __m128i cr = _mm_sub_epi16(half ? _mm_unpackhi_epi8(v8, zero) : _mm_unpacklo_epi8(v8, zero),
+				 chromaOffset);
+      __m128i luma = _mm_mullo_epi16(_mm_sub_epi16(y16, lumaOffset), lumaScale);
+      __m128i r = _mm_adds_epi16(luma, _mm_mullo_epi16(cr, crToR));
+      __m128i g = _mm_subs_epi16(_mm_subs_epi16(luma, _mm_mullo_epi16(cb, cbToG)),
+				 _mm_mullo_epi16(cr, crToG));
+      __m128i b = _mm_adds_epi16(luma, _mm_mullo_epi16(cb, cbToB));
+      rgb[0][half] = _mm_srai_epi16(_mm_adds_epi16(r, round), 6);
+      rgb[1][half] = _mm_srai_epi16(_mm_adds_epi16(g, round), 6);
+      rgb[2][half] = _mm_srai_epi16(_mm_adds_epi16(b, round), 6);
+    }
+    __m128i r8 = _mm_packus_epi16(rgb[0][0], rgb[0][1]);
+    __m128i g8 = _mm_packus_epi16(rgb[1][0], rgb[1][1]);
+    __m128i b8 = _mm_packus_epi16(rgb[2][0], rgb[2][1]);
+
+    // Interleave to B, G, R, A bytes, which is 0xAARRGGBB in memory order.
+    __m128i bgLo = _mm_unpacklo_epi8(b8, g8);
+    __m128i bgHi = _mm_unpackhi_epi8(b8, g8);
+    __m128i raLo = _mm_unpacklo_epi8(r8, alpha);
+    __m128i raHi = _mm_unpackhi_epi8(r8, alpha);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_unpacklo_epi16(bgLo, raLo));
+    _mm_storeu_si128((__m128i*)(dst + x + 4), _mm_unpackhi_epi16(bgLo, raLo));
+    _mm_storeu_si128((__m128i*)(dst + x + 8), _mm_unpacklo_epi16(bgHi, raHi));
+    _mm_storeu_si128((__m128i*)(dst + x + 12), _mm_unpackhi_epi16(bgHi, raHi));
+  }
+  // Odd tail; x is even so the chroma index stays aligned.
+  convertRowScalar(y + x, u + x / 2, v + x / 2, dst + x, width - x);
+}
+
+TARGET_AVX2 void convertRowAVX2(const Uint8 *y, const Uint8 *u, const Uint8 *v, Uint32 *dst,
+				int width) {
+  const __m256i lumaOffset = _mm256_set1_epi16(16);
+  const __m256i chromaOffset = _mm256_set1_epi16(128);
+  const __m256i lumaScale = _mm256_set1_epi16(75);
+  const __m256i crToR = _mm256_set1_epi16(102);
+  const __m256i cbToG = _mm256_set1_epi16(25);
+  const __m256i crToG = _mm256_set1_epi16(52);
+  const __m256i cbToB = _mm256_set1_epi16(129);
+  const __m256i round = _mm256_set1_epi16(32);
+  const __m256i byteMax = _mm256_set1_epi16(255);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha = _mm256_set1_epi16((short)0xFF00);
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    // Widen 16 pixels to 16 bit lanes in order, avoiding lane crossing.
+    __m256i y16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x)));
+    __m128i u8 = _mm_loadl_epi64((const __m128i*)(u + x / 2));
+    __m128i v8 = _mm_loadl_epi64((const __m128i*)(v + x / 2));
+    __m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u8, u8)), chromaOffset);
+    __m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v8, v8)), chromaOffset);
+
+    __m256i luma = _mm256_mullo_epi16(_mm256_sub_epi16(y16, lumaOffset), lumaScale);
+    __m256i r = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cr, crToR));
+    __m256i g = _mm256_subs_epi16(_mm256_subs_epi16(luma, _mm256_mullo_epi16(cb, cbToG)),
+				  _mm256_mullo_epi16(cr, crToG));
+    __m256i b = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cb, cbToB));
+    r = _mm256_srai_epi16(_mm256_adds_epi16(r, round), 6);
+    g = _mm256_srai_epi16(_mm256_adds_epi16(g, round), 6);
+    b = _mm256_srai_epi16(_mm256_adds_epi16(b, round), 6);
+    r = _mm256_min_epi16(_mm256_max_epi16(r, zero), byteMax);
+    g = _mm256_min_epi16(_mm256_max_epi16(g, zero), byteMax);
+    b = _mm256_min_epi16(_mm256_max_epi16(b, zero), byteMax);
+
+    // Build B|G<<8 and R|A<<8 words, then interleave them into pixels. The
+    // unpacks work per 128 bit lane, so the halves are put back in order.
+    __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+    __m256i ra = _mm256_or_si256(r, alpha);
+    __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+    __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst + x + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  convertRowScalar(y + x, u + x / 2, v + x / 2, dst + x, width - x);
+}
+#endif
+
+ConvertRowFunction selectConverter(const char **name) {
+#ifdef HAVE_X86_KERNELS
+  if (SDL_HasAVX2()) {
+    *name = "avx2";
+    return convertRowAVX2;
+  }
+  if (SDL_HasSSE2()) {
+    *name = "sse2";
+    return convertRowSSE2;
+  }
+#endif
+  *name = "scalar";
+  return convertRowScalar;
+}
+
+void convertFrame(ConvertRowFunction convertRow, const Uint8 *frame, SDL_Surface *target) {
+  int chromaWidth = (gVideo.width + 1) / 2;
+  int chromaHeight = (gVideo.height + 1) / 2;
+  const Uint8 *yPlane = frame;
+  const Uint8 *uPlane = yPlane + (size_t)gVideo.width * gVideo.height;
+  const Uint8 *vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+
+  if (SDL_MUSTLOCK(target)) {
+    SDL_LockSurface(target);
+  }
+  for (int row = 0; row < gVideo.height; row++) {
+    convertRow(yPlane + (size_t)row * gVideo.width,
+	       uPlane + (size_t)(row / 2) * chromaWidth,
+	       vPlane + (size_t)(row / 2) * chromaWidth,
+	       (Uint32*)((Uint8*)target->pixels + (size_t)row * target->pitch), gVideo.width);
+  }
+  if (SDL_MUSTLOCK(target)) {
+    SDL_UnlockSurface(target);
+  }
+}
+
+void play() {
+  if (!startReader()) {
+    std::cout << "Failed to start video reader!\n";
+    return;
+  }
+  const char *converterName;
+  ConvertRowFunction convertRow = selectConverter(&converterName);
+
+  // Convert straight into the window when it has the frame's size and format.
+  bool direct = gScreenSurface->format->format == SDL_PIXELFORMAT_RGB888 &&
+    gScreenSurface->w == gVideo.width && gScreenSurface->h == gVideo.height;
+
+  PlaybackStats stats = { 0, 0, 0, 0.0 };
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  Uint64 frameTicks = frequency * gVideo.fpsDen / gVideo.fpsNum;
+  Uint64 start = SDL_GetPerformanceCounter();
+  Uint32 lastReport = SDL_GetTicks();
+
+  // Main loop flag.
+  bool quit = false;
+  // Event handler.
+  SDL_Event e;
+  // Whether the current wait for the reader was already counted.
+  bool stalled = false;
+
+  // While application is running.
+  while (!quit) {
+    // Handle events on queue.
+    while (SDL_PollEvent(&e) != 0) {
+      // User requests quit.
+      if (e.type == SDL_QUIT) {
+	quit = true;
+      }
+    }
+
+    FrameSlot *slot = peekFrame();
+    if (slot == NULL) {
+      SDL_LockMutex(gReaderMutex);
+      bool ended = gReaderEnd && !gSlots[gTakeSlot].full;
+      SDL_UnlockMutex(gReaderMutex);
+      if (ended) {
+	break;
+      }
+      // The reader fell behind; count each stall once.
+      if (!stalled) {
+	stats.underruns++;
+	stalled = true;
+      }
+      SDL_Delay(1);
+      continue;
+    }
+    stalled = false;
+
+    // Frame n is due at start + n frame durations.
+    Uint64 due = start + frameTicks * slot->index;
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now > due + frameTicks) {
+      // Already a whole frame late; skip it to catch up.
+      stats.dropped++;
+      releaseFrame(slot);
+      continue;
+    }
+
+    Uint64 convertStart = SDL_GetPerformanceCounter();
+    convertFrame(convertRow, &slot->data[0], direct ? gScreenSurface : gFrameSurface);
+    stats.convertMs += (SDL_GetPerformanceCounter() - convertStart) * 1000.0 / frequency;
+    releaseFrame(slot);
+    if (!direct) {
+      SDL_BlitScaled(gFrameSurface, NULL, gScreenSurface, NULL);
+    }
+
+    // Sleep most of the way, then spin to the deadline.
+    now = SDL_GetPerformanceCounter();
+    if (due > now + frequency / 500) {
+      SDL_Delay((Uint32)((due - now) * 1000 / frequency) - 1);
+    }
+    while (SDL_GetPerformanceCounter() < due) {
+    }
+
+    // Update the surface.
+    SDL_UpdateWindowSurface(gWindow);
+    stats.presented++;
+
+    if (SDL_GetTicks() - lastReport >= 1000) {
+      char title[160];
+      snprintf(title, sizeof(title), "%s: %d shown, %d dropped, %d underruns, %.2f ms/convert",
+	       converterName, stats.presented, stats.dropped, stats.underruns,
+	       stats.convertMs / stats.presented);
+      SDL_SetWindowTitle(gWindow, title);
+      lastReport = SDL_GetTicks();
+    }
+  }
+  stopReader();
+
+  printf("%dx%d @ %d/%d fps, %s converter%s\n", gVideo.width, gVideo.height, gVideo.fpsNum,
+	 gVideo.fpsDen, converterName, direct ? ", direct to window" : "");
+  printf("presented %d, dropped %d, underruns %d, %.2f ms/convert\n", stats.presented,
+	 stats.dropped, stats.underruns, stats.presented ? stats.convertMs / stats.presented : 0.0);
+}
+
+void runBenchmark() {
+  struct Converter {
+    const char *name;
+    ConvertRowFunction convertRow;
+    bool supported;
+  };
+  Converter converters[] = {
+    { "scalar", convertRowScalar, true },
+#ifdef HAVE_X86_KERNELS
+    { "sse2", convertRowSSE2, SDL_HasSSE2() == SDL_TRUE },
+    { "avx2", convertRowAVX2, SDL_HasAVX2() == SDL_TRUE },
+#endif
+  };
+  const int numConverters = sizeof(converters) / sizeof(converters[0]);
+
+  // Time conversion only, on frames already in memory.
+  std::vector<Uint8> frame(gVideo.frameBytes);
+  SDL_RWops *file = SDL_RWFromFile(gVideoPath.c_str(), "rb");
+  if (file == NULL || SDL_RWseek(file, gVideo.dataOffset, RW_SEEK_SET) < 0 ||
+      !skipFrameMarker(file) ||
+      SDL_RWread(file, &frame[0], frame.size(), 1) != 1) {
+    std::cout << "Unable to read a frame from " << gVideoPath << "!\n";
+    if (file != NULL) {
+      SDL_RWclose(file);
+    }
+    return;
+  }
+  SDL_RWclose(file);
+
+  SDL_Surface *reference = SDL_CreateRGBSurfaceWithFormat(0, gVideo.width, gVideo.height, 32,
+							  SDL_PIXELFORMAT_RGB888);
+  convertFrame(convertRowScalar, &frame[0], reference);
+
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+  double frameMs = 1000.0 * gVideo.fpsDen / gVideo.fpsNum;
+  for (int i = 0; i < numConverters; i++) {
+    if (!converters[i].supported) {
+      printf("%-8s unsupported on this CPU\n", converters[i].name);
+      continue;
+    }
+    Uint64 begin = SDL_GetPerformanceCounter();
+    for (int n = 0; n < BENCHMARK_FRAMES; n++) {
+      convertFrame(converters[i].convertRow, &frame[0], gFrameSurface);
+    }
+    double ms = (SDL_GetPerformanceCounter() - begin) * 1000.0 / frequency / BENCHMARK_FRAMES;
+    bool exact = true;
+    for (int row = 0; row < gVideo.height && exact; row++) {
+      exact = memcmp((Uint8*)reference->pixels + row * reference->pitch,
+		     (Uint8*)gFrameSurface->pixels + row * gFrameSurface->pitch,
+		     gVideo.width * 4) == 0;
+    }
+    printf("%-8s %7.2f ms/frame %8.1f fps %5.1f%% of frame budget%s\n", converters[i].name, ms,
+	   1000.0 / ms, ms * 100.0 / frameMs, exact ? "" : " MISMATCH");
+  }
+  SDL_FreeSurface(reference);
+}
+
+bool generateClip(std::string path, int width, int height, int frames) {
+  SDL_RWops *file = SDL_RWFromFile(path.c_str(), "wb");
+  if (file == NULL) {
+    std::cout << "Unable to create video: " << path << "! SDL_Error: " << SDL_GetError() << "\n";
+    return false;
+  }
+  char header[128];
+  int headerBytes = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 C420jpeg\n",
+			     width, height);
+  SDL_RWwrite(file, header, headerBytes, 1);
+
+  // Moving diagonal luma bands over slowly rotating chroma.
+  int chromaWidth = (width + 1) / 2;
+  int chromaHeight = (height + 1) / 2;
+  std::vector<Uint8> frame((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+  bool success = true;
+  for (int n = 0; n < frames && success; n++) {
+    Uint8 *yPlane = &frame[0];
+    Uint8 *uPlane = yPlane + (size_t)width * height;
+    Uint8 *vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+    for (int row = 0; row < height; row++) {
+      for (int x = 0; x < width; x++) {
+	yPlane[(size_t)row * width + x] = 16 + ((x + row + n * 8) % 220);
+      }
+    }
+    for (int row = 0; row < chromaHeight; row++) {
+      for (int x = 0; x < chromaWidth; x++) {
+	uPlane[(size_t)row * chromaWidth + x] = 16 + ((x * 224 / chromaWidth + n) % 225);
+	vPlane[(size_t)row * chromaWidth + x] = 16 + ((row * 224 / chromaHeight + 2 * n) % 225);
+      }
+    }
+    success = SDL_RWwrite(file, "FRAME\n", 6, 1) == 1 &&
+      SDL_RWwrite(file, &frame[0], frame.size(), 1) == 1;
+  }
+  SDL_RWclose(file);
+  if (!success) {
+    std::cout << "Unable to write video: " << path << "!\n";
+  }
+  return success;
+}
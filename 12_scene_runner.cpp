@@ -0,0 +1,219 @@
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#else
+#include <SDL.h>
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "surface_registry.h"
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// Key press surfaces constants.
+enum KeyPressSurfaces {
+  KEY_PRESS_SURFACE_DEFAULT,
+  KEY_PRESS_SURFACE_UP,
+  KEY_PRESS_SURFACE_DOWN,
+  KEY_PRESS_SURFACE_LEFT,
+  KEY_PRESS_SURFACE_RIGHT,
+  KEY_PRESS_SURFACE_TOTAL
+};
+
+// Lessons 01 to 06 as scenes.
+bool loadHelloWorld();
+void renderHelloSDL(SDL_Surface *screen);
+void renderHelloWorld(SDL_Surface *screen);
+bool loadEventHandling();
+void renderEventHandling(SDL_Surface *screen);
+bool loadKeyPresses();
+void handleKeyPressEvent(const SDL_Event &e);
+void renderKeyPresses(SDL_Surface *screen);
+bool loadStretch();
+bool loadImage();
+void renderStretched(SDL_Surface *screen);
+void unloadStretched();
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// Screen dimension constants.
+const int SCREEN_WIDTH = 640;
+const int SCREEN_HEIGHT = 480;
+// Frames per scene for --bench.
+const int DEFAULT_BENCH_FRAMES = 120;
+
+// Every image the scenes use, prefetched at startup.
+const char *ASSET_PATHS[] = {
+  "02_getting_an_image_on_the_screen/hello_world.bmp",
+  "03_event_driven_programming/x.bmp",
+  "04_key_presses/press.bmp",
+  "04_key_presses/up.bmp",
+  "04_key_presses/down.bmp",
+  "04_key_presses/left.bmp",
+  "04_key_presses/right.bmp",
+  "05_optimized_surface_loading_and_soft_stretching/stretch.bmp",
+  "06_extension_libraries_and_loading_other_image_formats/loaded.png"
+};
+const int ASSET_COUNT = sizeof(ASSET_PATHS) / sizeof(ASSET_PATHS[0]);
+
+// Paths of the key press images, indexed by KeyPressSurfaces.
+const char *KEY_PRESS_PATHS[KEY_PRESS_SURFACE_TOTAL] = {
+  "04_key_presses/press.bmp",
+  "04_key_presses/up.bmp",
+  "04_key_presses/down.bmp",
+  "04_key_presses/left.bmp",
+  "04_key_presses/right.bmp"
+};
+
+Scene SCENES[] = {
+  { "01 Hello SDL", NULL, NULL, NULL, renderHelloSDL, NULL },
+  { "02 Hello World", loadHelloWorld, NULL, NULL, renderHelloWorld, NULL },
+  { "03 Event Handling", loadEventHandling, NULL, NULL, renderEventHandling, NULL },
+  { "04 Key Presses", loadKeyPresses, handleKeyPressEvent, NULL, renderKeyPresses, NULL },
+  { "05 Surface Load and Stretch", loadStretch, NULL, NULL, renderStretched, unloadStretched },
+  { "06 Image", loadImage, NULL, NULL, renderStretched, unloadStretched }
+};
+const int SCENE_COUNT = sizeof(SCENES) / sizeof(SCENES[0]);
+
+// Images of the current scene; owned by the engine.
+SDL_Surface *gHelloWorld = NULL;
+SDL_Surface *gXOut = NULL;
+SDL_Surface *gKeyPressSurfaces[KEY_PRESS_SURFACE_TOTAL];
+SDL_Surface *gCurrentSurface = NULL;
+SDL_Surface *gStretchedSurface = NULL;
+
+int main(int argc, char **argv) {
+  // Track surface memory before anything is allocated.
+  initSurfaceRegistry();
+
+  // Start up SDL and create window.
+  if (!engineInit("SDL Tutorial", SCREEN_WIDTH, SCREEN_HEIGHT)) {
+    std::cout << "Failed to initialize!\n";
+  }
+  else {
+    // Decode every scene's images on the workers while the first scene runs.
+    enginePrefetch(std::vector<std::string>(ASSET_PATHS, ASSET_PATHS + ASSET_COUNT));
+    engineSetScenes(SCENES, SCENE_COUNT);
+
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+      int frames = argc > 2 ? atoi(argv[2]) : DEFAULT_BENCH_FRAMES;
+      engineBenchmark(frames > 0 ? frames : DEFAULT_BENCH_FRAMES);
+    }
+    else {
+      // Start with the scene given on the command line, if any.
+      int first = argc > 1 ? atoi(argv[1]) - 1 : 0;
+      engineSwitchScene(first >= 0 && first < SCENE_COUNT ? first : 0);
+      engineRun();
+    }
+  }
+  // Free resources and quit SDL.
+  engineQuit();
+
+  return 0;
+}
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+void renderHelloSDL(SDL_Surface *screen) {
+  // Fill the surface white.
+  SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0xFF, 0xFF, 0xFF));
+}
+
+bool loadHelloWorld() {
+  gHelloWorld = engineLoadSurface("02_getting_an_image_on_the_screen/hello_world.bmp");
+  return gHelloWorld != NULL;
+}
+
+void renderHelloWorld(SDL_Surface *screen) {
+  // Apply the image.
+  SDL_BlitSurface(gHelloWorld, NULL, screen, NULL);
+}
+
+bool loadEventHandling() {
+  gXOut = engineLoadSurface("03_event_driven_programming/x.bmp");
+  return gXOut != NULL;
+}
+
+void renderEventHandling(SDL_Surface *screen) {
+  // Apply the image.
+  SDL_BlitSurface(gXOut, NULL, screen, NULL);
+}
+
+bool loadKeyPresses() {
+  // Loading success flag.
+  bool success = true;
+
+  for (int i = 0; i < KEY_PRESS_SURFACE_TOTAL; i++) {
+    gKeyPressSurfaces[i] = engineLoadSurface(KEY_PRESS_PATHS[i]);
+    if (gKeyPressSurfaces[i] == NULL) {
+      success = false;
+    }
+  }
+
+  // Set default current surface.
+  gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT];
+  return success;
+}
+
+void handleKeyPressEvent(const SDL_Event &e) {
+  // Select surfaces based on key press.
+  if (e.type == SDL_KEYDOWN) {
+    switch (e.key.keysym.sym) {
+    case SDLK_UP:
+      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_UP];
+      break;
+    case SDLK_DOWN:
+      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DOWN];
+      break;
+    case SDLK_LEFT:
+      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_LEFT];
+      break;
+    case SDLK_RIGHT:
+      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_RIGHT];
+      break;
+    default:
+      gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT];
+      break;
+    }
+  }
+}
+
+void renderKeyPresses(SDL_Surface *screen) {
+  // Apply the current image.
+  SDL_BlitSurface(gCurrentSurface, NULL, screen, NULL);
+}
+
+bool loadStretch() {
+  gStretchedSurface = engineLoadSurface("05_optimized_surface_loading_and_soft_stretching/stretch.bmp");
+  return gStretchedSurface != NULL;
+}
+
+bool loadImage() {
+  gStretchedSurface = engineLoadSurface("06_extension_libraries_and_loading_other_image_formats/loaded.png");
+  return gStretchedSurface != NULL;
+}
+
+void renderStretched(SDL_Surface *screen) {
+  // Apply the image stretched.
+  SDL_Rect stretchRect;
+  stretchRect.x = 0;
+  stretchRect.y = 0;
+  stretchRect.w = SCREEN_WIDTH;
+  stretchRect.h = SCREEN_HEIGHT;
+  SDL_BlitScaled(gStretchedSurface, NULL, screen, &stretchRect);
+}
+
+void unloadStretched() {
+  // The engine keeps the surface; only forget which one this scene drew.
+  gStretchedSurface = NULL;
+}
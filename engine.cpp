@@ -0,0 +1,476 @@
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#include <SDL2_image/SDL_image.h>
+#else
+#include <SDL.h>
+#include <SDL_image.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "surface_registry.h"
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// A unit of work for the worker threads.
+struct EngineJob {
+  void (*run)(void *data);
+  void *data;
+};
+
+// Upper bound on worker threads.
+const int MAX_WORKERS = 8;
+
+SDL_Window *gWindow = NULL;
+SDL_Surface *gScreenSurface = NULL;
+
+// Converted assets by path.
+std::map<std::string, SDL_Surface*> gAssetCache;
+// Assets loaded by the current scene, which must not be evicted.
+std::set<std::string> gPinnedAssets;
+// SDL_image codecs initialized so far.
+int gImageFlags = 0;
+
+// Worker threads and their queue, guarded by gJobMutex.
+std::vector<SDL_Thread*> gWorkers;
+SDL_mutex *gJobMutex = NULL;
+// Signalled when a job is queued.
+SDL_cond *gJobQueued = NULL;
+// Signalled when a job finishes.
+SDL_cond *gJobFinished = NULL;
+std::deque<EngineJob> gJobs;
+int gJobsRunning = 0;
+bool gWorkersQuit = false;
+// Images being decoded by prefetch jobs, and the finished results.
+std::set<std::string> gDecoding;
+std::map<std::string, SDL_Surface*> gDecoded;
+
+// Scenes and the current one.
+Scene *gScenes = NULL;
+int gSceneCount = 0;
+int gCurrentScene = -1;
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+static int workerThread(void *) {
+  SDL_LockMutex(gJobMutex);
+  while (true) {
+    while (gJobs.empty() && !gWorkersQuit) {
+      SDL_CondWait(gJobQueued, gJobMutex);
+    }
+    if (gJobs.empty()) {
+      break;
+    }
+    EngineJob job = gJobs.front();
+    gJobs.pop_front();
+    gJobsRunning++;
+    SDL_UnlockMutex(gJobMutex);
+
+    job.run(job.data);
+
+    SDL_LockMutex(gJobMutex);
+    gJobsRunning--;
+    SDL_CondBroadcast(gJobFinished);
+  }
+  SDL_UnlockMutex(gJobMutex);
+  return 0;
+}
+
+bool engineInit(const char *title, int width, int height) {
+  // Initialization flag.
+  bool success = true;
+
+  // Initialize SDL.
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    std::cout << "SDL could not initialize! SDL_Error: " <<
+      SDL_GetError() << "\n";
+    success = false;
+  }
+  else {
+    // Create window.
+    gWindow = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED,
+			      SDL_WINDOWPOS_UNDEFINED, width, height,
+			      SDL_WINDOW_SHOWN);
+    if (gWindow == NULL) {
+      std::cout << "Window could not be created! SDL_Error: " <<
+	SDL_GetError() << "\n";
+      success = false;
+    }
+    else {
+      // Get window surface.
+      gScreenSurface = trackSurface(SDL_GetWindowSurface(gWindow), "window",
+				    SURFACE_CATEGORY_SCREEN);
+    }
+  }
+  if (!success) {
+    return false;
+  }
+
+  // One worker per spare core, leaving the main thread its own.
+  gJobMutex = SDL_CreateMutex();
+  gJobQueued = SDL_CreateCond();
+  gJobFinished = SDL_CreateCond();
+  gWorkersQuit = false;
+  int workers = std::max(1, std::min(MAX_WORKERS, SDL_GetCPUCount() - 1));
+  for (int i = 0; i < workers; i++) {
+    SDL_Thread *worker = SDL_CreateThread(workerThread, "EngineWorker", NULL);
+    if (worker != NULL) {
+      gWorkers.push_back(worker);
+    }
+  }
+  if (gWorkers.empty()) {
+    std::cout << "Worker threads could not be created! SDL_Error: " << SDL_GetError() << "\n";
+    return false;
+  }
+  return true;
+}
+
+void engineQuit() {
+  // Unload the current scene.
+  if (gCurrentScene >= 0 && gScenes[gCurrentScene].unload != NULL) {
+    gScenes[gCurrentScene].unload();
+  }
+  gCurrentScene = -1;
+
+  // Stop the workers once the queue is drained.
+  if (gJobMutex != NULL) {
+    SDL_LockMutex(gJobMutex);
+    gWorkersQuit = true;
+    SDL_CondBroadcast(gJobQueued);
+    SDL_UnlockMutex(gJobMutex);
+  }
+  for (size_t i = 0; i < gWorkers.size(); i++) {
+    SDL_WaitThread(gWorkers[i], NULL);
+  }
+  gWorkers.clear();
+  SDL_DestroyCond(gJobFinished);
+  SDL_DestroyCond(gJobQueued);
+  SDL_DestroyMutex(gJobMutex);
+  gJobFinished = NULL;
+  gJobQueued = NULL;
+  gJobMutex = NULL;
+
+  // Deallocate surfaces.
+  for (std::map<std::string, SDL_Surface*>::iterator it = gDecoded.begin(); it != gDecoded.end(); ++it) {
+    SDL_FreeSurface(it->second);
+  }
+  gDecoded.clear();
+  for (std::map<std::string, SDL_Surface*>::iterator it = gAssetCache.begin();
+       it != gAssetCache.end(); ++it) {
+    freeTrackedSurface(it->second);
+  }
+  gAssetCache.clear();
+  gPinnedAssets.clear();
+  untrackSurface(gScreenSurface);
+  gScreenSurface = NULL;
+
+  // Destroy window.
+  SDL_DestroyWindow(gWindow);
+  gWindow = NULL;
+
+  // Quit SDL subsystems.
+  IMG_Quit();
+  SDL_Quit();
+}
+
+void engineRunJob(void (*job)(void *data), void *data) {
+  EngineJob queued = { job, data };
+  SDL_LockMutex(gJobMutex);
+  gJobs.push_back(queued);
+  SDL_CondSignal(gJobQueued);
+  SDL_UnlockMutex(gJobMutex);
+}
+
+void engineWaitForJobs() {
+  SDL_LockMutex(gJobMutex);
+  while (!gJobs.empty() || gJobsRunning > 0) {
+    SDL_CondWait(gJobFinished, gJobMutex);
+  }
+  SDL_UnlockMutex(gJobMutex);
+}
+
+// True for files SDL decodes itself without SDL_image.
+static bool isBMP(const std::string &path) {
+  std::string extension = path.substr(path.find_last_of('.') + 1);
+  for (size_t i = 0; i < extension.size(); i++) {
+    extension[i] = tolower(extension[i]);
+  }
+  return extension == "bmp";
+}
+
+// Initializes the SDL_image codec for path if it is not ready yet. Must run
+// on the main thread.
+static void initCodecFor(const std::string &path) {
+  std::string extension = path.substr(path.find_last_of('.') + 1);
+  for (size_t i = 0; i < extension.size(); i++) {
+    extension[i] = tolower(extension[i]);
+  }
+  int flag = 0;
+  if (extension == "png") flag = IMG_INIT_PNG;
+  else if (extension == "jpg" || extension == "jpeg") flag = IMG_INIT_JPG;
+  else if (extension == "tif" || extension == "tiff") flag = IMG_INIT_TIF;
+  else if (extension == "webp") flag = IMG_INIT_WEBP;
+  if (flag != 0 && !(gImageFlags & flag)) {
+    if (IMG_Init(flag) & flag) {
+      gImageFlags |= flag;
+    }
+    else {
+      std::cout << "SDL_Image could not initialize! SDL_Image error: " <<
+	IMG_GetError() << "\n";
+    }
+  }
+}
+
+// Decodes without converting; safe on any thread once the codec is ready.
+static SDL_Surface* decodeSurface(const std::string &path) {
+  return isBMP(path) ? SDL_LoadBMP(path.c_str()) : IMG_Load(path.c_str());
+}
+
+static void decodeJob(void *data) {
+  std::string *path = (std::string*)data;
+  SDL_Surface *decoded = decodeSurface(*path);
+  SDL_LockMutex(gJobMutex);
+  gDecoded[*path] = decoded;
+  gDecoding.erase(*path);
+  SDL_UnlockMutex(gJobMutex);
+  delete path;
+}
+
+void enginePrefetch(const std::vector<std::string> &paths) {
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (gAssetCache.count(paths[i]) != 0) {
+      continue;
+    }
+    initCodecFor(paths[i]);
+    SDL_LockMutex(gJobMutex);
+    bool queued = gDecoding.count(paths[i]) != 0 || gDecoded.count(paths[i]) != 0;
+    if (!queued) {
+      gDecoding.insert(paths[i]);
+    }
+    SDL_UnlockMutex(gJobMutex);
+    if (!queued) {
+      engineRunJob(decodeJob, new std::string(paths[i]));
+    }
+  }
+}
+
+// Drops an asset no current scene uses when the surface budget needs room.
+static void evictAsset(SDL_Surface *surface, void *) {
+  for (std::map<std::string, SDL_Surface*>::iterator it = gAssetCache.begin();
+       it != gAssetCache.end(); ++it) {
+    if (it->second == surface) {
+      gAssetCache.erase(it);
+      break;
+    }
+  }
+  freeTrackedSurface(surface);
+}
+
+// Keeps path resident until unpinAssets(); pinned assets are tracked without
+// an evictor.
+static SDL_Surface* pinAsset(const std::string &path, SDL_Surface *surface) {
+  gPinnedAssets.insert(path);
+  return trackSurface(surface, path, SURFACE_CATEGORY_ASSET);
+}
+
+// Lets the registry evict the assets of the scene being left.
+static void unpinAssets() {
+  for (std::set<std::string>::iterator it = gPinnedAssets.begin(); it != gPinnedAssets.end(); ++it) {
+    std::map<std::string, SDL_Surface*>::iterator cached = gAssetCache.find(*it);
+    if (cached != gAssetCache.end()) {
+      trackSurface(cached->second, *it, SURFACE_CATEGORY_ASSET, evictAsset);
+    }
+  }
+  gPinnedAssets.clear();
+}
+
+SDL_Surface* engineLoadSurface(std::string path) {
+  std::map<std::string, SDL_Surface*>::iterator cached = gAssetCache.find(path);
+  if (cached != gAssetCache.end()) {
+    return pinAsset(path, cached->second);
+  }
+
+  // Take a prefetched decode, waiting for it if it is still running.
+  SDL_Surface* loadedSurface = NULL;
+  bool prefetched = false;
+  SDL_LockMutex(gJobMutex);
+  while (gDecoding.count(path) != 0) {
+    SDL_CondWait(gJobFinished, gJobMutex);
+  }
+  std::map<std::string, SDL_Surface*>::iterator decoded = gDecoded.find(path);
+  if (decoded != gDecoded.end()) {
+    loadedSurface = decoded->second;
+    gDecoded.erase(decoded);
+    prefetched = true;
+  }
+  SDL_UnlockMutex(gJobMutex);
+  if (!prefetched) {
+    initCodecFor(path);
+    loadedSurface = decodeSurface(path);
+  }
+
+  SDL_Surface* optimizedSurface = NULL;
+  if (loadedSurface == NULL) {
+    std::cout << "Unable to load image: " << path << "! SDL_Error: " <<
+      SDL_GetError() << "\n";
+  }
+  else {
+    // Convert surface to screen format, downscaled if over budget.
+    trackSurface(loadedSurface, path, SURFACE_CATEGORY_TEMPORARY);
+    optimizedSurface = trackSurface(convertSurfaceWithinBudget(loadedSurface, gScreenSurface->format),
+				    path, SURFACE_CATEGORY_ASSET);
+    if (optimizedSurface == NULL) {
+      std::cout << "Unable to optimize image: " << path << "! SDL_Error: " <<
+	SDL_GetError() << "\n";
+    }
+    else {
+      gAssetCache[path] = optimizedSurface;
+      pinAsset(path, optimizedSurface);
+    }
+    freeTrackedSurface(loadedSurface);
+  }
+  return optimizedSurface;
+}
+
+void engineSetScenes(Scene *scenes, int count) {
+  gScenes = scenes;
+  gSceneCount = count;
+}
+
+// Runs the load hook of the scene at index and makes it current on success.
+static bool loadScene(int index) {
+  Scene &scene = gScenes[index];
+  if (scene.load != NULL && !scene.load()) {
+    std::cout << "Failed to load scene " << scene.name << "!\n";
+    // Let the scene drop whatever it did load.
+    if (scene.unload != NULL) {
+      scene.unload();
+    }
+    unpinAssets();
+    return false;
+  }
+  gCurrentScene = index;
+  SDL_SetWindowTitle(gWindow, scene.name);
+  return true;
+}
+
+bool engineSwitchScene(int index) {
+  if (index < 0 || index >= gSceneCount) {
+    return false;
+  }
+  int previous = gCurrentScene;
+  if (previous >= 0 && gScenes[previous].unload != NULL) {
+    gScenes[previous].unload();
+  }
+  unpinAssets();
+  gCurrentScene = -1;
+  if (loadScene(index)) {
+    return true;
+  }
+
+  // Go back to the previous scene, or the first one, rather than leaving a
+  // half loaded scene current.
+  if (previous >= 0 && previous != index && loadScene(previous)) {
+    return false;
+  }
+  if (index != 0 && previous != 0) {
+    loadScene(0);
+  }
+  return false;
+}
+
+// Runs one frame of the current scene.
+static void engineFrame(Uint32 deltaMs) {
+  Scene &scene = gScenes[gCurrentScene];
+  if (scene.update != NULL) {
+    scene.update(deltaMs);
+  }
+  if (scene.render != NULL) {
+    scene.render(gScreenSurface);
+  }
+
+  // Update the surface.
+  SDL_UpdateWindowSurface(gWindow);
+}
+
+void engineRun() {
+  // Main loop flag.
+  bool quit = false;
+  // Event handler.
+  SDL_Event e;
+  Uint32 lastTicks = SDL_GetTicks();
+
+  // While application is running.
+  while (!quit && gCurrentScene >= 0) {
+    // Dump surface memory on SIGUSR1.
+    pollSurfaceRegistrySignal();
+
+    // Handle events on queue.
+    while (SDL_PollEvent(&e) != 0) {
+      // User requests quit.
+      if (e.type == SDL_QUIT) {
+	quit = true;
+      }
+      else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_TAB) {
+	engineSwitchScene((gCurrentScene + 1) % gSceneCount);
+      }
+      else if (e.type == SDL_KEYDOWN && e.key.keysym.sym >= SDLK_1 && e.key.keysym.sym <= SDLK_9) {
+	engineSwitchScene(e.key.keysym.sym - SDLK_1);
+      }
+      else if (gScenes[gCurrentScene].handleEvent != NULL) {
+	gScenes[gCurrentScene].handleEvent(e);
+      }
+
+      // A failed switch whose fallbacks also failed leaves no scene to
+      // dispatch to or draw.
+      if (gCurrentScene < 0) {
+	break;
+      }
+    }
+    if (gCurrentScene < 0) {
+      std::cout << "No scene could be loaded!\n";
+      break;
+    }
+
+    Uint32 ticks = SDL_GetTicks();
+    engineFrame(ticks - lastTicks);
+    lastTicks = ticks;
+  }
+}
+
+void engineBenchmark(int frames) {
+  Uint64 frequency = SDL_GetPerformanceFrequency();
+
+  // The first pass pays for decoding and conversion, the second shows the
+  // cost of switching back to scenes whose assets are already resident.
+  printf("%-5s %-28s %10s %10s\n", "pass", "scene", "switch ms", "ms/frame");
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < gSceneCount; i++) {
+      Uint64 start = SDL_GetPerformanceCounter();
+      bool loaded = engineSwitchScene(i);
+      Uint64 switched = SDL_GetPerformanceCounter();
+      for (int frame = 0; frame < frames && loaded; frame++) {
+	SDL_PumpEvents();
+	engineFrame(1000 / 60);
+      }
+      Uint64 end = SDL_GetPerformanceCounter();
+      printf("%-5s %-28s %10.3f %10.3f\n", pass == 0 ? "cold" : "warm", gScenes[i].name,
+	     (switched - start) * 1000.0 / frequency,
+	     frames > 0 ? (end - switched) * 1000.0 / frequency / frames : 0.0);
+    }
+  }
+  printf("peak surface memory %lu bytes\n", (unsigned long)peakTrackedBytes());
+}
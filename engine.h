@@ -0,0 +1,81 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#else
+#include <SDL.h>
+#endif
+
+#include <string>
+#include <vector>
+
+// Shared runtime for running several lessons as scenes in one process. The
+// window, converted assets and worker threads live as long as the engine,
+// so switching scenes only pays for what the new scene has not used before.
+//
+// Programs using the engine are built together with engine.cpp.
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// A lesson turned into a scene. Any hook may be NULL.
+struct Scene {
+  const char *name;
+  // Called when the scene becomes current. Assets come from
+  // engineLoadSurface() and stay owned by the engine; load them here every
+  // time, since they may have been evicted while the scene was not current.
+  bool (*load)();
+  // Called for every event the engine does not handle itself.
+  void (*handleEvent)(const SDL_Event &e);
+  // Called once per frame with the milliseconds since the last frame.
+  void (*update)(Uint32 deltaMs);
+  // Draws the frame; the engine presents it.
+  void (*render)(SDL_Surface *screen);
+  // Called when another scene becomes current.
+  void (*unload)();
+};
+
+// Starts up SDL, creates the window and the worker threads.
+bool engineInit(const char *title, int width, int height);
+// Frees every cached asset and shuts down SDL.
+void engineQuit();
+
+// Returns the image at path converted to the screen format; do not free the
+// result. Conversions are cached and stay resident while the scene that
+// loaded them is current. Under a surface budget, assets of earlier scenes
+// are evicted first and loaded again when needed.
+SDL_Surface* engineLoadSurface(std::string path);
+// Decodes images on the worker threads so later loads only convert.
+void enginePrefetch(const std::vector<std::string> &paths);
+
+// Runs job(data) on a worker thread.
+void engineRunJob(void (*job)(void *data), void *data);
+// Waits until every job posted so far has finished.
+void engineWaitForJobs();
+
+// Sets the scenes the runner can switch between.
+void engineSetScenes(Scene *scenes, int count);
+// Unloads the current scene and loads the one at index. If that fails,
+// returns false with the previous scene, or the first one, current again.
+// If those fail to load too, no scene is current afterwards and engineRun()
+// returns.
+bool engineSwitchScene(int index);
+// Runs the current scene until the user quits. Tab and the number keys
+// switch scenes.
+void engineRun();
+// Runs every scene back to back for the given number of frames, twice, and
+// prints switch and frame times.
+void engineBenchmark(int frames);
+
+// --------------------
+// -------------------- Globals --------------------
+// --------------------
+
+// The window we will render to.
+extern SDL_Window *gWindow;
+// The surface contained by the window.
+extern SDL_Surface *gScreenSurface;
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef SURFACE_REGISTRY_H
+#define SURFACE_REGISTRY_H
+
+#ifdef __APPLE__
+#include <SDL2/SDL.h>
+#else
+#include <SDL.h>
+#endif
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+// Keeps count of the pixel memory held by SDL surfaces, per surface, per
+// asset and per category, and enforces an optional soft budget.
+//
+// The registry is not thread safe; register and free surfaces on the main
+// thread only.
+
+// --------------------
+// -------------------- Prototypes --------------------
+// --------------------
+
+// What a surface is used for.
+enum SurfaceCategory {
+		      SURFACE_CATEGORY_SCREEN,
+		      SURFACE_CATEGORY_ASSET,
+		      SURFACE_CATEGORY_TEMPORARY,
+		      SURFACE_CATEGORY_TOTAL,
+};
+
+// Called to release an evictable surface when the budget is exceeded. The
+// callback must drop its own references and call freeTrackedSurface().
+typedef void (*SurfaceEvictor)(SDL_Surface *surface, void *data);
+
+// A registered surface.
+struct TrackedSurface {
+  std::string asset;
+  SurfaceCategory category;
+  size_t bytes;
+  // NULL if the surface cannot be evicted.
+  SurfaceEvictor evictor;
+  void *evictorData;
+  // Order of last use, for picking eviction victims.
+  Uint32 lastUse;
+};
+
+// Reads the budget from SURFACE_BUDGET_MB and installs the SIGUSR1 dump
+// handler.
+void initSurfaceRegistry();
+// Registers surface and returns it. NULL surfaces are ignored.
+SDL_Surface* trackSurface(SDL_Surface *surface, const std::string &asset,
+			  SurfaceCategory category, SurfaceEvictor evictor = NULL,
+			  void *evictorData = NULL);
+// Forgets surface without freeing it, for surfaces owned by SDL.
+void untrackSurface(SDL_Surface *surface);
+// Forgets and frees surface.
+void freeTrackedSurface(SDL_Surface *surface);
+// Marks surface as recently used so it is evicted last.
+void touchTrackedSurface(SDL_Surface *surface);
+// Evicts surfaces until bytes more fit in the budget. Returns false if they
+// still do not fit.
+bool reserveSurfaceBytes(size_t bytes);
+// Sets the soft budget in bytes; 0 disables it.
+void setSurfaceBudget(size_t bytes);
+// Converts surface to format, halving its size until it fits the budget but
+// no further than SURFACE_MAX_DOWNSCALE_STEPS halvings. Converts at full size
+// if surfaces that cannot be evicted already exceed the budget. The result is
+// not tracked.
+SDL_Surface* convertSurfaceWithinBudget(SDL_Surface *surface, const SDL_PixelFormat *format);
+
+// Bytes currently held, in total, per category and per asset.
+size_t trackedBytes();
+size_t trackedBytes(SurfaceCategory category);
+size_t trackedBytes(const std::string &asset);
+// Largest total ever held.
+size_t peakTrackedBytes();
+// Pixel bytes a surface of the given size and format would take.
+size_t surfaceBytes(int w, int h, const SDL_PixelFormat *format);
+// Prints every surface and the totals.
+void dumpSurfaceRegistry();
+// Dumps the registry if SIGUSR1 arrived since the last call.
+void pollSurfaceRegistrySignal();
+
+// --------------------
+// -------------------- Implementation --------------------
+// --------------------
+
+// How many times convertSurfaceWithinBudget() may halve a surface, so the
+// fallback is never smaller than a quarter of the original width and height.
+const int SURFACE_MAX_DOWNSCALE_STEPS = 2;
+
+// Registry state, kept in one place so the header can be included by any
+// number of programs.
+struct SurfaceRegistry {
+  std::map<SDL_Surface*, TrackedSurface> surfaces;
+  size_t categoryBytes[SURFACE_CATEGORY_TOTAL];
+  size_t totalBytes;
+  size_t peakBytes;
+  size_t budgetBytes;
+  Uint32 useCounter;
+  int evictions;
+};
+
+inline SurfaceRegistry& surfaceRegistry() {
+  static SurfaceRegistry registry = SurfaceRegistry();
+  return registry;
+}
+
+// Set from the signal handler, read by pollSurfaceRegistrySignal().
+inline volatile std::sig_atomic_t& surfaceRegistryDumpRequested() {
+  static volatile std::sig_atomic_t requested = 0;
+  return requested;
+}
+
+inline void requestSurfaceRegistryDump(int) {
+  surfaceRegistryDumpRequested() = 1;
+}
+
+inline void initSurfaceRegistry() {
+  const char *budget = getenv("SURFACE_BUDGET_MB");
+  if (budget != NULL) {
+    char *end = NULL;
+    long megabytes = strtol(budget, &end, 10);
+    if (end == budget || *end != '\0' || megabytes <= 0) {
+      printf("Ignoring SURFACE_BUDGET_MB=%s, expected a positive number of megabytes\n", budget);
+    }
+    else {
+      setSurfaceBudget((size_t)megabytes * 1024 * 1024);
+    }
+  }
+#ifdef SIGUSR1
+  std::signal(SIGUSR1, requestSurfaceRegistryDump);
+#endif
+}
+
+inline size_t surfaceBytes(int w, int h, const SDL_PixelFormat *format) {
+  // Same 4-byte row alignment SDL uses for its own allocations.
+  size_t pitch = ((size_t)w * format->BytesPerPixel + 3) & ~(size_t)3;
+  return pitch * h;
+}
+
+inline SDL_Surface* trackSurface(SDL_Surface *surface, const std::string &asset,
+				 SurfaceCategory category, SurfaceEvictor evictor,
+				 void *evictorData) {
+  if (surface == NULL) {
+    return NULL;
+  }
+  SurfaceRegistry &registry = surfaceRegistry();
+  untrackSurface(surface);
+
+  TrackedSurface tracked;
+  tracked.asset = asset;
+  tracked.category = category;
+  tracked.bytes = (size_t)surface->pitch * surface->h;
+  tracked.evictor = evictor;
+  tracked.evictorData = evictorData;
+  tracked.lastUse = ++registry.useCounter;
+  registry.surfaces[surface] = tracked;
+
+  registry.categoryBytes[category] += tracked.bytes;
+  registry.totalBytes += tracked.bytes;
+  if (registry.totalBytes > registry.peakBytes) {
+    registry.peakBytes = registry.totalBytes;
+  }
+  return surface;
+}
+
+inline void untrackSurface(SDL_Surface *surface) {
+  SurfaceRegistry &registry = surfaceRegistry();
+  std::map<SDL_Surface*, TrackedSurface>::iterator it = registry.surfaces.find(surface);
+  if (it == registry.surfaces.end()) {
+    return;
+  }
+  registry.categoryBytes[it->second.category] -= it->second.bytes;
+  registry.totalBytes -= it->second.bytes;
+  registry.surfaces.erase(it);
+}
+
+inline void freeTrackedSurface(SDL_Surface *surface) {
+  untrackSurface(surface);
+  SDL_FreeSurface(surface);
+}
+
+inline void touchTrackedSurface(SDL_Surface *surface) {
+  SurfaceRegistry &registry = surfaceRegistry();
+  std::map<SDL_Surface*, TrackedSurface>::iterator it = registry.surfaces.find(surface);
+  if (it != registry.surfaces.end()) {
+    it->second.lastUse = ++registry.useCounter;
+  }
+}
+
+inline bool reserveSurfaceBytes(size_t bytes) {
+  SurfaceRegistry &registry = surfaceRegistry();
+  if (registry.budgetBytes == 0) {
+    return true;
+  }
+  while (registry.totalBytes + bytes > registry.budgetBytes) {
+    // Evict the least recently used evictable surface.
+    std::map<SDL_Surface*, TrackedSurface>::iterator victim = registry.surfaces.end();
+    for (std::map<SDL_Surface*, TrackedSurface>::iterator it = registry.surfaces.begin();
+	 it != registry.surfaces.end(); ++it) {
+      if (it->second.evictor != NULL &&
+	  (victim == registry.surfaces.end() || it->second.lastUse < victim->second.lastUse)) {
+	victim = it;
+      }
+    }
+    if (victim == registry.surfaces.end()) {
+      return false;
+    }
+    SDL_Surface *surface = victim->first;
+    TrackedSurface tracked = victim->second;
+    tracked.evictor(surface, tracked.evictorData);
+    // Make sure the loop ends even if the callback did not free it.
+    untrackSurface(surface);
+    registry.evictions++;
+  }
+  return true;
+}
+
+inline void setSurfaceBudget(size_t bytes) {
+  surfaceRegistry().budgetBytes = bytes;
+}
+
+inline SDL_Surface* convertSurfaceWithinBudget(SDL_Surface *surface,
+						const SDL_PixelFormat *format) {
+  int w = surface->w;
+  int h = surface->h;
+  int steps = 0;
+  while (!reserveSurfaceBytes(surfaceBytes(w, h, format))) {
+    // Nothing left to evict and the fixed surfaces alone are over budget;
+    // shrinking this one would not bring us back under it.
+    if (!reserveSurfaceBytes(0)) {
+      printf("Surface budget exceeded by surfaces that cannot be evicted, "
+	     "converting %dx%d at full size\n", surface->w, surface->h);
+      w = surface->w;
+      h = surface->h;
+      break;
+    }
+    if (steps == SURFACE_MAX_DOWNSCALE_STEPS) {
+      printf("Surface budget exceeded, %dx%d does not fit even at %dx%d\n",
+	     surface->w, surface->h, w, h);
+      break;
+    }
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+    steps++;
+  }
+  if (w == surface->w && h == surface->h) {
+    return SDL_ConvertSurface(surface, format, 0);
+  }
+
+  // Downscaled fallback; callers that stretch to the screen look the same,
+  // only blurrier.
+  printf("Surface budget exceeded, downscaling %dx%d to %dx%d\n", surface->w, surface->h, w, h);
+  SDL_Surface *scaled = SDL_CreateRGBSurface(0, w, h, format->BitsPerPixel, format->Rmask,
+					     format->Gmask, format->Bmask, format->Amask);
+  if (scaled != NULL) {
+    SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+    SDL_BlitScaled(surface, NULL, scaled, NULL);
+  }
+  return scaled;
+}
+
+inline size_t trackedBytes() {
+  return surfaceRegistry().totalBytes;
+}
+
+inline size_t trackedBytes(SurfaceCategory category) {
+  return surfaceRegistry().categoryBytes[category];
+}
+
+inline size_t trackedBytes(const std::string &asset) {
+  SurfaceRegistry &registry = surfaceRegistry();
+  size_t bytes = 0;
+  for (std::map<SDL_Surface*, TrackedSurface>::iterator it = registry.surfaces.begin();
+       it != registry.surfaces.end(); ++it) {
+    if (it->second.asset == asset) {
+      bytes += it->second.bytes;
+    }
+  }
+  return bytes;
+}
+
+inline size_t peakTrackedBytes() {
+  return surfaceRegistry().peakBytes;
+}
+
+inline void dumpSurfaceRegistry() {
+  const char *categoryNames[SURFACE_CATEGORY_TOTAL] = { "screen", "asset", "temporary" };
+  SurfaceRegistry &registry = surfaceRegistry();
+
+  // Per-asset totals, since an asset may own several surfaces.
+  std::map<std::string, size_t> assetBytes;
+  printf("%-10s %12s  %s\n", "category", "bytes", "asset");
+  for (std::map<SDL_Surface*, TrackedSurface>::iterator it = registry.surfaces.begin();
+       it != registry.surfaces.end(); ++it) {
+    printf("%-10s %12lu  %s%s\n", categoryNames[it->second.category],
+	   (unsigned long)it->second.bytes, it->second.asset.c_str(),
+	   it->second.evictor != NULL ? " (evictable)" : "");
+    assetBytes[it->second.asset] += it->second.bytes;
+  }
+  for (std::map<std::string, size_t>::iterator it = assetBytes.begin(); it != assetBytes.end(); ++it) {
+    printf("asset      %12lu  %s\n", (unsigned long)it->second, it->first.c_str());
+  }
+  for (int i = 0; i < SURFACE_CATEGORY_TOTAL; i++) {
+    printf("total      %12lu  %s\n", (unsigned long)registry.categoryBytes[i], categoryNames[i]);
+  }
+  printf("total      %12lu  current\n", (unsigned long)registry.totalBytes);
+  printf("total      %12lu  peak\n", (unsigned long)registry.peakBytes);
+  if (registry.budgetBytes != 0) {
+    printf("budget     %12lu  (%d evictions)\n", (unsigned long)registry.budgetBytes,
+	   registry.evictions);
+  }
+  fflush(stdout);
+}
+
+inline void pollSurfaceRegistrySignal() {
+  if (surfaceRegistryDumpRequested()) {
+    surfaceRegistryDumpRequested() = 0;
+    dumpSurfaceRegistry();
+  }
+}
+
+#endif